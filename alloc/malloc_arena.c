@@ -0,0 +1,136 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC
+
+#include "malloc_priv.h"
+
+
+/* Arena management :
+ * - an arena is a region (given by wmalloc() or static) in which buffers are
+ *   allocated by simply increasing the used size (no header, no free)
+ * - all the buffers of the arena are released at once by warena_reset()
+ */
+
+#define ARENA_WORD          ((physaddr_t) sizeof(uint32_t))
+#define ARENA_ROUND(a)      (((a) + ARENA_WORD - 1) & ~(ARENA_WORD - 1))
+
+
+
+/*********************************************************************************************/
+/*  Arena initialization                                                                     */
+/*********************************************************************************************/
+int warena_init(warena_t *arena, void *region, const uint32_t size, const int flag)
+{
+    if (!arena || !region || !size) {
+        malloc_errno = EARENAPARAM;
+        return -1;
+    }
+
+    if ((flag != ALLOC_NORMAL) && (flag != ALLOC_SENSITIVE)) {
+        malloc_errno = EHEAPFLAGNOTVALID;
+        return -1;
+    }
+
+    /* The region must not wrap around the address space */
+    if ((physaddr_t) region + size < (physaddr_t) region) {
+        malloc_errno = EARENAPARAM;
+        return -1;
+    }
+
+    arena->start = (uint8_t *) region;
+    arena->size  = size;
+    arena->used  = 0;
+    arena->flag  = flag;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_init(&arena->lock);
+#endif
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Bump allocation                                                                          */
+/*********************************************************************************************/
+int warena_alloc(warena_t *arena, void **ptr_to_alloc, const uint32_t len)
+{
+    physaddr_t ptr;
+    uint32_t   off;
+
+    if (!arena || !ptr_to_alloc || !len) {
+        malloc_errno = EARENAPARAM;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    if (!mutex_trylock(&arena->lock)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    /* Buffers are word aligned, whatever the region alignment */
+    ptr = ARENA_ROUND((physaddr_t) arena->start + arena->used);
+    off = (uint32_t) (ptr - (physaddr_t) arena->start);
+
+    if ((off > arena->size) || (len > arena->size - off)) {
+        malloc_errno = EHEAPNOMEM;
+        goto end_error;
+    }
+
+    arena->used = off + len;
+
+    *ptr_to_alloc = (void *) ptr;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_unlock(&arena->lock);
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_unlock(&arena->lock);
+#endif
+
+    return -1;
+}
+
+/*********************************************************************************************/
+/*  Release of all the buffers                                                               */
+/*********************************************************************************************/
+int warena_reset(warena_t *arena)
+{
+    if (!arena) {
+        malloc_errno = EARENAPARAM;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    if (!mutex_trylock(&arena->lock)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    /* RAZ of the used part of the arena (the remaining part has never been given) */
+    if (arena->flag == ALLOC_SENSITIVE) {
+        _safe_flood_char((char *) arena->start, CHAR_ZERO, arena->used);
+    }
+
+    arena->used = 0;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_unlock(&arena->lock);
+#endif
+
+    return 0;
+}
+
+#endif
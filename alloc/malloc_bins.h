@@ -0,0 +1,202 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#ifndef H_MALLOC_BINS
+#define H_MALLOC_BINS
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC_BINS
+
+#include "malloc_priv.h"
+
+
+/* OPTIONS **********************************************************************/
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+# define CANARIS_INTEGRITY      1
+#endif
+
+/********************************************************************************/
+
+
+/* Chunk structure :
+ * - size and and previous chunk's size
+ * - double linked list for free chunks of the same bin: relative pointers to
+ *   previous and next free chunks of the bin (0 terminates the list, as offset 0
+ *   is b_0 which is never part of a bin)
+ */
+/*#pragma pack (1)*/
+struct __attribute__((packed)) block {
+#if CANARIS_INTEGRITY == 1
+    u_can_t can_sz;
+#endif
+    u_flg_t flag;
+    u__sz_t prv_sz;
+    u__sz_t sz;
+    u_off_t prv_free;  /* Only for free blocks: relative address */
+    u_off_t nxt_free;  /* Only for free blocks: relative address */
+#if (CANARIS_INTEGRITY == 1) && (CONFIG_STD_MALLOC_NB_CANARIES >= 2)
+    u_can_t can_free;
+#endif
+};
+
+struct __attribute__((packed)) alloc_block {
+#if CANARIS_INTEGRITY == 1
+    u_can_t can_sz;
+#endif
+    u_flg_t flag;
+    u__sz_t prv_sz;
+    u__sz_t sz;
+};
+
+
+
+/* Bins management
+ *
+ * Free blocks are dispatched in NB_BINS bins depending on their size:
+ * - small bins hold blocks of exactly one granule of BIN_GRANULE bytes
+ *   (small requests are rounded up to the granule, so that any block of the
+ *   first fitting bin can be used without searching)
+ * - large bins hold blocks in a power of two range [2^n, 2^(n+1)[, the last
+ *   bin holding all the bigger blocks
+ * A bitmap of the non-empty bins permits to find the first fitting bin
+ * with a single CTZ instruction.
+ */
+
+#define BIN_GRANULE_LOG2    3
+#define BIN_SMALL_LOG2      7
+
+#define BIN_GRANULE         ((u__sz_t) (1 << BIN_GRANULE_LOG2))
+#define BIN_SMALL_LIMIT     ((u__sz_t) (1 << BIN_SMALL_LOG2))
+
+#define NB_SMALL_BINS       (1 << (BIN_SMALL_LOG2 - BIN_GRANULE_LOG2))
+#define NB_BINS             32
+
+#define ROUND_SMALL(sz)     ((u__sz_t) (((sz) + BIN_GRANULE - 1) & ~(BIN_GRANULE - 1)))
+
+#define LOG2(x)             (31 - __builtin_clz((uint32_t) (x)))
+#define FIRST_BIN(map)      ((uint8_t) __builtin_ctz((uint32_t) (map)))
+
+
+
+/* Chunks management */
+
+#define OFFSET_MAX          (u__sz_t)(_heap_size - HDR_FREE_SZ)
+
+#define OFFSET(b)           ((u_off_t) ((physaddr_t)(b) - _start_heap))
+#define BLOCK(o)            ((struct block *)(_start_heap + (physaddr_t)(o)))
+
+#define HDR_SZ              ((u__sz_t) sizeof(struct alloc_block))
+#define HDR_FREE_SZ         ((u__sz_t) sizeof(struct block))
+
+#define MASK_ALLOC          ((u_flg_t) 0x01010101)
+#define MASK_FREE           ((u_flg_t) 0xFEFEFEFE)
+
+#define IS_ALLOC(b)         (((b)->flag & MASK_ALLOC) == MASK_ALLOC)
+#define IS_FREE(b)          (((b)->flag & MASK_ALLOC) == 0)
+
+#define MAKE_ALLOC(b)       ((struct block *)(b))->flag |= MASK_ALLOC
+#define MAKE_FREE(b)        ((struct block *)(b))->flag &= MASK_FREE
+
+#define MASK_SENSITIVE      ((u_flg_t) 0xFEFE)
+#define MASK_NORMAL         ((u_flg_t) 0x0101)
+
+#define IS_SENSITIVE(b)     (((b)->flag & MASK_SENSITIVE) == MASK_SENSITIVE)
+#define IS_NORMAL(b)        (((b)->flag & MASK_SENSITIVE) == 0)
+
+#define MAKE_SENSITIVE(b)   ((struct block *)(b))->flag |= MASK_SENSITIVE
+#define MAKE_NORMAL(b)      ((struct block *)(b))->flag &= MASK_NORMAL
+
+#define BAD_FLAG(b)         (((((b)->flag & MASK_ALLOC) != MASK_ALLOC) && \
+                              (((b)->flag & MASK_ALLOC) != 0)) || \
+                             ((((b)->flag & MASK_SENSITIVE) != MASK_SENSITIVE) && \
+                              (((b)->flag & MASK_SENSITIVE) != 0)))
+
+#define SIZE(b)             ((b)->sz)
+#define PRV_SIZE(b)         ((b)->prv_sz)
+
+#define NEXT(b)             ((struct block *) ((physaddr_t)(b) + SIZE(b)))
+#define PREV(b)             ((struct block *) ((physaddr_t)(b) - PRV_SIZE(b)))
+
+#define PRV_FREE(b)         BLOCK((b)->prv_free)
+#define NXT_FREE(b)         BLOCK((b)->nxt_free)
+
+#define FIRST_BLOCK(b)      ((physaddr_t)(b) == (physaddr_t) (_start_heap + HDR_FREE_SZ))
+#define NOT_FIRST_BLOCK(b)  ((physaddr_t)(b) != (physaddr_t) (_start_heap + HDR_FREE_SZ))
+
+#define LAST_BLOCK(b)       ((physaddr_t)(b) + SIZE(b) == _end_heap)
+#define NOT_LAST_BLOCK(b)   ((physaddr_t)(b) + SIZE(b) != _end_heap)
+
+
+
+/* Canaries mamangement */
+
+#if CANARIS_INTEGRITY == 1
+
+#define CAN_SHIFT               CONFIG_STD_MALLOC_SIZE_LEN
+
+# define SUM_SZ(b)              (u_can_t) ((((u_can_t)((b)->prv_sz)) << CAN_SHIFT) ^ \
+                                            ((u_can_t)((b)->sz)))
+
+# define SUM_FREE(b)            (u_can_t) ((((u_can_t)((b)->prv_free)) << CAN_SHIFT) ^ \
+                                            ((u_can_t)((b)->nxt_free)))
+
+# define MIX_CAN(c)             (u_can_t) ((u_can_t)(c) ^ ((u_can_t)(c)<<5) ^ ((u_can_t)(c)>>7))
+
+# define SUM_CAN(x,c)           MIX_CAN(((u_can_t) (x) ^ (c)))
+
+# define CANARI_SZ(b)           SUM_CAN(SUM_SZ(b), _can_sz)
+# define UPDATE_CANARI_SZ(b)    (b)->can_sz   = CANARI_SZ(b)
+# define BAD_CANARI_SZ(b)       ((b)->can_sz != CANARI_SZ(b))
+
+# if CONFIG_STD_MALLOC_NB_CANARIES >= 2
+
+#  define CANARI_FREE(b)        SUM_CAN(SUM_FREE(b), _can_free)
+#  define UPDATE_CANARI_FREE(b) (b)->can_free = CANARI_FREE(b)
+#  define BAD_CANARI_FREE(b)    ((b)->can_free != CANARI_FREE(b))
+
+# else
+
+/* With only one canari, free lists pointers are not protected */
+#  define UPDATE_CANARI_FREE(b)
+#  define BAD_CANARI_FREE(b)    0
+
+# endif
+
+# define UPDATE_CANARI_GENE(b)  UPDATE_CANARI_SZ(b); \
+                                    if (IS_FREE(b)) { UPDATE_CANARI_FREE(b); }
+
+# define UPDATE_CANARI_BOTH(b)  UPDATE_CANARI_SZ(b); \
+                                    UPDATE_CANARI_FREE(b)
+
+# define BAD_CANARI(b)          (BAD_CANARI_SZ(b) || \
+                                    (IS_FREE(b) && BAD_CANARI_FREE(b)))
+
+#endif
+
+
+
+/* Bock 0 management */
+
+#define NB_FREE()               b_0->prv_sz /* For checking integrity */
+
+#define SZ_FREE()               b_0->sz     /* For checking available free memory */
+
+# define INCREASE_NB_FREE()     b_0->prv_sz = (u__sz_t) (NB_FREE() + 1)
+# define DECREASE_NB_FREE()     b_0->prv_sz = (u__sz_t) (NB_FREE() - 1)
+
+# define INCREASE_SZ_FREE(l)    SZ_FREE() = (u__sz_t)(SZ_FREE() + (l))
+# define DECREASE_SZ_FREE(l)    SZ_FREE() = (u__sz_t)(SZ_FREE() - (l))
+
+
+/*
+ * This function should be called by wmalloc_init() once the initial
+ * blocks have been set, in order to dispatch them into the bins
+ */
+void malloc_bins_init(void);
+
+#endif
+#endif
@@ -0,0 +1,1020 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC_BITMAP
+
+#include "malloc_priv.h"
+
+
+/* Global variables */
+
+/* Heap specifications (the start is aligned on a granule, and the size is a whole
+ * number of granules) */
+static physaddr_t _start_heap;
+static physaddr_t _end_heap;
+static u__sz_t    _heap_size;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+/* Semaphore (address of the wmalloc semaphore, set by _set_wmalloc_semaphore()) */
+static volatile uint32_t _ptr_semaphore;
+#endif
+
+/* Statistics (counters of the allocator functions, see wmalloc_stats()) */
+static struct wmalloc_stats _stats;
+
+/* Bitmaps (bit i of the word w for the granule 32 * w + i). These are kept out of
+ * the heap so that an overflow of an allocated block cannot corrupt them */
+static uint32_t _used[NB_WORDS_MAX];        /* Allocated granules */
+static uint32_t _last[NB_WORDS_MAX];        /* Last granule of each allocated block */
+static uint32_t _sensitive[NB_WORDS_MAX];   /* First granule of each sensitive block */
+
+static uint32_t _nb_granules;               /* Granules of the heap */
+static uint32_t _nb_words;                  /* Words of each bitmap */
+static uint32_t _nb_free;                   /* Free granules */
+
+
+/* Static functions prototypes */
+static int _alloc(void **ptr_to_alloc, const u__sz_t len, const uint32_t align, const int flag);
+static void _mark(const uint32_t g, const uint32_t n, const int flag);
+static int _free(void **ptr_to_free);
+static uint32_t _block(const void *ptr);
+static uint32_t _find(const uint32_t n, const uint32_t align, uint32_t *skip);
+static uint32_t _scan(const uint32_t *map, const uint32_t g, const uint32_t bit);
+static void _fill(uint32_t *map, uint32_t g, uint32_t n, const uint32_t bit);
+static int _resize(const uint32_t g, const uint32_t cur_n, const uint32_t n);
+
+
+
+/****************************************************************************************/
+/*  Initialization of the bitmaps                                                       */
+/****************************************************************************************/
+int malloc_bitmap_init(void)
+{
+    physaddr_t start = 0;
+    uint32_t i;
+
+    /* Getting of heap specification values */
+    _set_wmalloc_heap(&_start_heap, &_end_heap, &_heap_size);
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    _set_wmalloc_semaphore(&_ptr_semaphore);
+#endif
+
+    /* The heap is cut to whole granules (as far as the bitmaps can hold them) */
+    start = (_start_heap + GRANULE_SZ - 1) & ~((physaddr_t) GRANULE_SZ - 1);
+
+    _nb_granules = (_end_heap > start ? (uint32_t) ((_end_heap - start) >> GRANULE_LOG2) : 0);
+
+    if (_nb_granules > NB_GRANULES_MAX) {
+        _nb_granules = NB_GRANULES_MAX;
+    }
+
+    if (!_nb_granules) {
+        malloc_errno = EHEAPSIZETOOSMALL;
+        return -1;
+    }
+
+    _nb_words   = (_nb_granules + MAP_BITS - 1) >> MAP_LOG2;
+    _nb_free    = _nb_granules;
+
+    _start_heap = start;
+    _heap_size  = (u__sz_t) (_nb_granules << GRANULE_LOG2);
+    _end_heap   = _start_heap + _heap_size;
+
+    memset(&_stats, 0, sizeof(_stats));
+
+    for (i = 0; i < _nb_words; ++i) {
+        _used[i]      = 0;
+        _last[i]      = 0;
+        _sensitive[i] = 0;
+    }
+
+    /* The bits following the last granule are set as allocated, so that no free run
+     * goes beyond the heap */
+    if (_nb_granules & (MAP_BITS - 1)) {
+        _used[_nb_words - 1] = 0xFFFFFFFF << (_nb_granules & (MAP_BITS - 1));
+    }
+
+    return 0;
+}
+
+
+/*********************************************************************************************/
+/*  Malloc() function                                                                        */
+/*********************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc(void **ptr_to_alloc, const uint16_t len, const int flag)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
+#endif
+{
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    /* The default heap is set by the first allocation */
+    LAZY_INIT();
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+    /* Small blocks are first taken from the cache of the calling context (no locking) */
+    if (!_wmalloc_cache_get(ptr_to_alloc, (uint32_t) len, flag)) {
+        return 0;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Trying to lock of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(_get_wmalloc_heap());
+#endif
+
+    /* The block is allocated */
+    if (_alloc(ptr_to_alloc, (u__sz_t) len, 1, flag) < 0) {
+        goto end_error;
+    }
+
+    /* Successful allocation is counted and traced */
+    STATS_ALLOC();
+    TRACE((flag == ALLOC_SENSITIVE ? WMALLOC_TRACE_ALLOC_SENSITIVE : WMALLOC_TRACE_ALLOC),
+          len, *ptr_to_alloc);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+    /* Failed allocation is counted and traced */
+    STATS_FAILED();
+    TRACE_FAILED(WMALLOC_TRACE_ALLOC, len);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+
+/****************************************************************************************/
+/*  Allocation of a block (wmalloc usage must be locked, returns the size skipped       */
+/*  before the block for its alignment)                                                 */
+/****************************************************************************************/
+static int _alloc(void **ptr_to_alloc, const u__sz_t len, const uint32_t align, const int flag)
+{
+    uint32_t n      = NB_GRANULES(len ? len : 1);
+    uint32_t g      = 0;
+    uint32_t skip   = 0;
+
+    /* Checking of the validity of the flag */
+    if ((flag != ALLOC_NORMAL) && (flag != ALLOC_SENSITIVE)) {
+        malloc_errno = EHEAPFLAGNOTVALID;
+        return -1;
+    }
+
+#if CONFIG_STD_MALLOC_CHECK_IF_NULL == 1
+    /* We check if the pointer has not already been allocated */
+    if (*ptr_to_alloc) {
+        malloc_errno = EHEAPALREADYALLOC;
+        return -1;
+    }
+#endif
+
+    /* We check if there is free memory into heap */
+    if (!_nb_free) {
+        malloc_errno = EHEAPFULL;
+        return -1;
+    }
+
+    if (n > _nb_free) {
+        malloc_errno = EHEAPNOMEM;
+        return -1;
+    }
+
+    /* The first free run large enough is allocated */
+    if ((g = _find(n, align, &skip)) == _nb_granules) {
+        malloc_errno = EHEAPNOMEM;
+        return -1;
+    }
+
+    _mark(g, n, flag);
+
+    *ptr_to_alloc = ADDRESS(g);
+
+    return (int) (skip << GRANULE_LOG2);
+}
+
+/****************************************************************************************/
+/*  Marking of n granules as an allocated block (wmalloc usage must be locked)          */
+/****************************************************************************************/
+static void _mark(const uint32_t g, const uint32_t n, const int flag)
+{
+    _fill(_used, g, n, 1);
+    _fill(_last, g + n - 1, 1, 1);
+
+    _nb_free -= n;
+
+    /* RAZ of the whole memory reserved for new allocated block's data */
+    if (flag == ALLOC_SENSITIVE) {
+        _fill(_sensitive, g, 1, 1);
+        _safe_flood_char((char *) ADDRESS(g), CHAR_WRITTEN, n << GRANULE_LOG2);
+    }
+}
+
+/****************************************************************************************/
+/*  Aligned malloc() function                                                           */
+/****************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_aligned(void **ptr_to_alloc, const uint16_t len, const uint32_t align, const int flag)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_aligned(void **ptr_to_alloc, const uint32_t len, const uint32_t align, const int flag)
+#endif
+{
+    int lead = 0;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    /* The default heap is set by the first allocation */
+    LAZY_INIT();
+
+    /* The alignment must be a power of two */
+    if (!align || (align & (align - 1))) {
+        malloc_errno = EHEAPALIGN;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Trying to lock of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(_get_wmalloc_heap());
+#endif
+
+    /* The granules skipped for the alignment are left free (no block to split) */
+    if ((lead = _alloc(ptr_to_alloc, (u__sz_t) len, align, flag)) < 0) {
+        goto end_error;
+    }
+
+    /* Successful allocation is counted and traced, with its alignment slack */
+    STATS_ALLOC();
+    STATS_ALIGNED(lead);
+    TRACE((flag == ALLOC_SENSITIVE ? WMALLOC_TRACE_ALLOC_SENSITIVE : WMALLOC_TRACE_ALLOC),
+          len, *ptr_to_alloc);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+    /* Failed allocation is counted and traced */
+    STATS_FAILED();
+    TRACE_FAILED(WMALLOC_TRACE_ALLOC, len);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+/****************************************************************************************/
+/*  Bulk functions: pending releases and checks (wmalloc usage must be locked)          */
+/****************************************************************************************/
+int _wmalloc_bulk_begin(struct wheap *heap, const int release)
+{
+    (void) heap;
+    (void) release;
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Bulk functions: allocation of n blocks of len bytes (wmalloc usage must be locked)  */
+/****************************************************************************************/
+int _wmalloc_bulk_carve(struct wheap *heap, void **ptrs, const uint32_t n, const uint32_t len,
+                        const int flag)
+{
+    uint32_t nb_gr      = NB_GRANULES(len ? len : 1);
+    uint32_t g          = 0;
+    uint32_t skip       = 0;
+    uint32_t i;
+
+    (void) heap;
+
+    if ((flag != ALLOC_NORMAL) && (flag != ALLOC_SENSITIVE)) {
+        malloc_errno = EHEAPFLAGNOTVALID;
+        return -1;
+    }
+
+    /* The n blocks are carved into one free run, which must fit into the free memory */
+    if (n > _nb_free / nb_gr) {
+        malloc_errno = (_nb_free ? EHEAPNOMEM : EHEAPFULL);
+        return -1;
+    }
+
+    if ((g = _find(n * nb_gr, 1, &skip)) == _nb_granules) {
+        malloc_errno = EHEAPNOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        _mark(g + i * nb_gr, nb_gr, flag);
+        ptrs[i] = ADDRESS(g + i * nb_gr);
+    }
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Bulk functions: extension of a run of blocks (wmalloc usage must be locked)         */
+/****************************************************************************************/
+int _wmalloc_bulk_next(struct wheap *heap, void *first, void *last, void *ptr)
+{
+    (void) heap;
+    (void) first;
+    (void) last;
+    (void) ptr;
+
+    /* Adjacent free runs need no merging: each block is released alone */
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Bulk functions: release of a run of blocks (wmalloc usage must be locked)           */
+/****************************************************************************************/
+int _wmalloc_bulk_free(struct wheap *heap, void **ptrs, const uint32_t n)
+{
+    (void) heap;
+    (void) n;
+
+    return _free(ptrs);
+}
+
+/****************************************************************************************/
+/*  Bulk functions: counting of the calls (wmalloc usage must be locked)                */
+/****************************************************************************************/
+void _wmalloc_bulk_stats(struct wheap *heap, const uint32_t nb_allocs, const uint32_t nb_frees,
+                         const uint32_t nb_failed)
+{
+    (void) heap;
+
+    _stats.nb_allocs += nb_allocs;
+    _stats.nb_frees  += nb_frees;
+    _stats.nb_failed += nb_failed;
+
+    STATS_MAX_USED();
+}
+
+/****************************************************************************************/
+/*  First free run of n granules, its start being aligned (_nb_granules if none)        */
+/****************************************************************************************/
+static uint32_t _find(const uint32_t n, const uint32_t align, uint32_t *skip)
+{
+    uint32_t g      = 0;
+    uint32_t g_al   = 0;
+    uint32_t g_end  = 0;
+
+    /* Each free run is bounded by two scans of the allocated granules bitmap */
+    while ((g = _scan(_used, g_end, 0)) < _nb_granules) {
+
+        STATS_SCAN();
+
+        g_end = _scan(_used, g, 1);
+        g_al  = g;
+
+        if (align > GRANULE_SZ) {
+            g_al += (uint32_t) (((align - ((physaddr_t) ADDRESS(g) & (align - 1))) & (align - 1))
+                                >> GRANULE_LOG2);
+        }
+
+        if ((g_al < g_end) && (g_end - g_al >= n)) {
+            *skip = g_al - g;
+            return g_al;
+        }
+    }
+
+    return _nb_granules;
+}
+
+/****************************************************************************************/
+/*  First granule from g whose bit is set (or clear) in a bitmap (_nb_granules if none) */
+/****************************************************************************************/
+static uint32_t _scan(const uint32_t *map, const uint32_t g, const uint32_t bit)
+{
+    uint32_t inv    = (bit ? 0 : 0xFFFFFFFF);
+    uint32_t w      = g >> MAP_LOG2;
+    uint32_t x      = 0;
+
+    if (g >= _nb_granules) {
+        return _nb_granules;
+    }
+
+    /* The bits of the first word before g are masked */
+    x = (map[w] ^ inv) & (0xFFFFFFFF << (g & (MAP_BITS - 1)));
+
+    while (!x) {
+        if (++w == _nb_words) {
+            return _nb_granules;
+        }
+        x = map[w] ^ inv;
+    }
+
+    w = (w << MAP_LOG2) + FIRST_BIT(x);
+
+    return (w < _nb_granules ? w : _nb_granules);
+}
+
+/****************************************************************************************/
+/*  Setting (or clearing) of n bits of a bitmap from the granule g                      */
+/****************************************************************************************/
+static void _fill(uint32_t *map, uint32_t g, uint32_t n, const uint32_t bit)
+{
+    uint32_t mask   = 0;
+    uint32_t nb     = 0;
+
+    while (n) {
+        nb   = MAP_BITS - (g & (MAP_BITS - 1));
+        nb   = (n < nb ? n : nb);
+        mask = (nb == MAP_BITS ? 0xFFFFFFFF : ((((uint32_t) 1 << nb) - 1) << (g & (MAP_BITS - 1))));
+
+        if (bit) {
+            map[g >> MAP_LOG2] |= mask;
+        } else {
+            map[g >> MAP_LOG2] &= ~mask;
+        }
+
+        g += nb;
+        n -= nb;
+    }
+}
+
+/****************************************************************************************/
+/*  Number of granules of the allocated block starting at ptr (0 if not a block)        */
+/****************************************************************************************/
+static uint32_t _block(const void *ptr)
+{
+    uint32_t g      = GRANULE(ptr);
+    uint32_t g_lst  = 0;
+
+    /* The granule must be allocated, and the previous one must be free or the last one
+     * of its block (a pointer into a block is not a block) */
+    if (NOT_GRANULE(ptr) || !TEST(_used, g) ||
+        (g && TEST(_used, g - 1) && !TEST(_last, g - 1))) {
+        return 0;
+    }
+
+    g_lst = _scan(_last, g, 1);
+
+    if ((g_lst == _nb_granules) || (_scan(_used, g, 0) <= g_lst)) {
+        return 0;
+    }
+
+    return g_lst - g + 1;
+}
+
+
+/****************************************************************************************/
+/*  Free() function                                                                     */
+/****************************************************************************************/
+int wfree(void **ptr_to_free)
+{
+    void *ptr = NULL;
+#ifdef CONFIG_STD_MALLOC_CACHE
+    int ret   = 0;
+#endif
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+    /* Small blocks are kept by the cache of the calling context (no locking) */
+    if ((ret = _wmalloc_cache_put(ptr_to_free)) <= 0) {
+        return ret;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+# ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+        /* The block is released later by the lock holder */
+        return _defer(_get_wmalloc_heap(), ptr_to_free);
+# else
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+# endif
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(_get_wmalloc_heap());
+#endif
+
+    /* The block is released, then counted and traced */
+    ptr = *ptr_to_free;
+
+    if (_free(ptr_to_free) < 0) {
+        goto end_error;
+    }
+
+    STATS_FREE();
+    TRACE(WMALLOC_TRACE_FREE, 0, ptr);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+/****************************************************************************************/
+/*  Release of an allocated block (wmalloc usage must be locked, the caller counts it)  */
+/****************************************************************************************/
+static int _free(void **ptr_to_free)
+{
+    uint32_t g = 0;
+    uint32_t n = 0;
+
+    /* We check if the pointer is not null */
+    if (!(*ptr_to_free)) {
+        malloc_errno = EHEAPALREADYFREE;
+        return -1;
+    }
+
+    /* We check if the pointer is not out of range */
+    if (((physaddr_t) (*ptr_to_free) < _start_heap) ||
+        ((physaddr_t) (*ptr_to_free) >= _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        return -1;
+    }
+
+    /* We check if the pointer is the start of an allocated block (a released block
+     * is found free) */
+    if (!(n = _block(*ptr_to_free))) {
+        malloc_errno = EHEAPINTEGRITY;
+        return -1;
+    }
+
+    g = GRANULE(*ptr_to_free);
+
+    /* RAZ of the whole memory to free */
+    if (TEST(_sensitive, g)) {
+        _safe_flood_char((char *) (*ptr_to_free), CHAR_ZERO, n << GRANULE_LOG2);
+        _fill(_sensitive, g, 1, 0);
+    }
+
+    /* Granules set to "free" (the free runs around are merged by construction) */
+    _fill(_used, g, n, 0);
+    _fill(_last, g + n - 1, 1, 0);
+
+    _nb_free += n;
+
+    /* Pointer to allocated block is set to 0 */
+    *ptr_to_free = NULL;
+
+    return 0;
+}
+
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+/****************************************************************************************/
+/*  Deferred release: checks of a block without the lock (see malloc_defer.c)           */
+/****************************************************************************************/
+int _wmalloc_defer_check(struct wheap *heap, const void *ptr)
+{
+    (void) heap;
+
+    /* The bitmaps are fully checked when the block is really released */
+    if (((physaddr_t) ptr < _start_heap) || ((physaddr_t) ptr + PENDING_LINK_SZ > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        return -1;
+    }
+
+    if (NOT_GRANULE(ptr) || !TEST(_used, GRANULE(ptr))) {
+        malloc_errno = EHEAPINTEGRITY;
+        return -1;
+    }
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Deferred release: release of a pending block (wmalloc usage must be locked)         */
+/****************************************************************************************/
+int _wmalloc_defer_free(struct wheap *heap, void *ptr)
+{
+    (void) heap;
+
+    return _free(&ptr);
+}
+
+/****************************************************************************************/
+/*  Deferred release: counting of the pending releases                                  */
+/****************************************************************************************/
+void _wmalloc_defer_stats(struct wheap *heap, const uint32_t nb_frees, const uint32_t nb_bad)
+{
+    (void) heap;
+
+    _stats.nb_frees += nb_frees;
+
+    STATS_BAD_PENDING(nb_bad);
+}
+#endif
+
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+/****************************************************************************************/
+/*  Data length of a block which can be cached (0 if it must be released by the heap)  */
+/****************************************************************************************/
+uint32_t _wmalloc_cache_len(const void *ptr)
+{
+    /* Only the checks which do not need wmalloc usage to be locked are done here (the
+     * block being owned by the caller, its bits cannot be modified meanwhile), the
+     * bitmaps being fully checked when the block is really released */
+    if (!ptr || ((physaddr_t) ptr < _start_heap) || ((physaddr_t) ptr >= _end_heap)) {
+        return 0;
+    }
+
+    if (NOT_GRANULE(ptr) || TEST(_sensitive, GRANULE(ptr))) {
+        return 0;
+    }
+
+    return _block(ptr) << GRANULE_LOG2;
+}
+#endif
+
+
+/****************************************************************************************/
+/*  Realloc() function                                                                  */
+/****************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wrealloc(void **ptr_to_realloc, const uint16_t len)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wrealloc(void **ptr_to_realloc, const uint32_t len)
+#endif
+{
+    void *ptr_new       = NULL;
+
+    uint32_t g          = 0;
+    uint32_t cur_n      = 0;
+    uint32_t old_len    = 0;
+
+    int flag            = ALLOC_NORMAL;
+    int ret             = 0;
+
+    /* A null pointer is simply allocated */
+    if (!(*ptr_to_realloc)) {
+        return wmalloc(ptr_to_realloc, len, ALLOC_NORMAL);
+    }
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(_get_wmalloc_heap());
+#endif
+
+    /* We check if the pointer is not out of range */
+    if (((physaddr_t) (*ptr_to_realloc) < _start_heap) ||
+        ((physaddr_t) (*ptr_to_realloc) >= _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    /* We check if the pointer is the start of an allocated block */
+    if (!(cur_n = _block(*ptr_to_realloc))) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+    g = GRANULE(*ptr_to_realloc);
+
+    /* The block is first resized in place */
+    if ((ret = _resize(g, cur_n, NB_GRANULES(len ? len : 1))) < 0) {
+        goto end_error;
+    }
+
+    if (!ret) {
+        /* The allocated memory may have grown (in place resizing is traced) */
+        STATS_MAX_USED();
+        TRACE(WMALLOC_TRACE_REALLOC, len, *ptr_to_realloc);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+        /* Unlocking of wmalloc usage */
+        if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+            malloc_errno = EHEAPSEMAPHORE;
+            return -1;
+        }
+#endif
+
+        return 0;
+    }
+
+    /* Else, the data are moved into a new block (the one of the pointer is kept
+     * until the copy is done, so that nothing is lost if no block fits) */
+    flag    = (TEST(_sensitive, g) ? ALLOC_SENSITIVE : ALLOC_NORMAL);
+    old_len = cur_n << GRANULE_LOG2;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (wmalloc() and wfree() lock it themselves) */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    if (wmalloc(&ptr_new, len, flag) < 0) {
+        return -1;
+    }
+
+    memcpy(ptr_new, *ptr_to_realloc, (old_len < len ? old_len : len));
+
+    if (wfree(ptr_to_realloc) < 0) {
+        return -1;
+    }
+
+    *ptr_to_realloc = ptr_new;
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+
+/****************************************************************************************/
+/*  Usable size of an allocated block (its data length, which may exceed the asked one) */
+/****************************************************************************************/
+int wmalloc_usable_size(const void *ptr, uint32_t *len)
+{
+    uint32_t n = 0;
+
+    if (!len) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    /* Only the bits of the block are read, without locking (the block being owned by
+     * the caller, its bits cannot be modified meanwhile) */
+    if (!ptr || ((physaddr_t) ptr < _start_heap) || ((physaddr_t) ptr >= _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        return -1;
+    }
+
+    if (!(n = _block(ptr))) {
+        malloc_errno = EHEAPINTEGRITY;
+        return -1;
+    }
+
+    *len = n << GRANULE_LOG2;
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Trim function (in place shrink of an allocated block)                               */
+/****************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_trim(void *ptr, const uint16_t len)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_trim(void *ptr, const uint32_t len)
+#endif
+{
+    uint32_t n      = NB_GRANULES(len ? len : 1);
+    uint32_t cur_n  = 0;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(_get_wmalloc_heap());
+#endif
+
+    /* We check if the pointer is not out of range */
+    if (((physaddr_t) ptr < _start_heap) || ((physaddr_t) ptr >= _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    /* We check if the pointer is the start of an allocated block */
+    if (!(cur_n = _block(ptr))) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+    /* A length not smaller than the current one leaves the block unchanged, else the
+     * granules of the tail are set free */
+    if (n < cur_n) {
+        _resize(GRANULE(ptr), cur_n, n);
+
+        TRACE(WMALLOC_TRACE_REALLOC, len, ptr);
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+
+
+/****************************************************************************************/
+
+/* Resizing of an allocated block in place, using the following free granules
+ * (returns 1 if the block cannot be resized in place) */
+static int _resize(const uint32_t g, const uint32_t cur_n, const uint32_t n)
+{
+    uint32_t g_end = g + cur_n;
+
+    if (n > cur_n) {
+        /* The following granules must be free */
+        if (_scan(_used, g_end, 1) - g_end < n - cur_n) {
+            return 1;
+        }
+
+        _fill(_used, g_end, n - cur_n, 1);
+        _nb_free -= n - cur_n;
+
+        /* RAZ of the memory added to the block's data */
+        if (TEST(_sensitive, g)) {
+            _safe_flood_char((char *) ADDRESS(g_end), CHAR_WRITTEN, (n - cur_n) << GRANULE_LOG2);
+        }
+
+    } else if (n < cur_n) {
+        /* RAZ of the memory given back */
+        if (TEST(_sensitive, g)) {
+            _safe_flood_char((char *) ADDRESS(g + n), CHAR_ZERO, (cur_n - n) << GRANULE_LOG2);
+        }
+
+        _fill(_used, g + n, cur_n - n, 0);
+        _nb_free += cur_n - n;
+
+    } else {
+        return 0;
+    }
+
+    /* The last granule of the block is moved */
+    _fill(_last, g_end - 1, 1, 0);
+    _fill(_last, g + n - 1, 1, 1);
+
+    return 0;
+}
+
+
+/****************************************************************************************/
+/*  Statistics of the heap                                                              */
+/****************************************************************************************/
+int wmalloc_stats(struct wmalloc_stats *stats)
+{
+    uint32_t g      = 0;
+    uint32_t g_end  = 0;
+
+    if (!stats) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    /* Counters are maintained by the allocator functions, the other values are
+     * read from the bitmaps */
+    stats->heap_sz          = (uint32_t) _heap_size;
+    stats->used_sz          = USED_SZ();
+    stats->free_sz          = SZ_FREE();
+    stats->max_used_sz      = _stats.max_used_sz;
+    stats->largest_free_sz  = 0;
+    stats->nb_free_blocks   = 0;
+    stats->nb_allocs        = _stats.nb_allocs;
+    stats->nb_frees         = _stats.nb_frees;
+    stats->nb_failed        = _stats.nb_failed;
+    stats->nb_aligned       = _stats.nb_aligned;
+    stats->align_slack_sz   = _stats.align_slack_sz;
+    stats->nb_scanned       = _stats.nb_scanned;
+    stats->nb_bad_pending   = _stats.nb_bad_pending;
+
+    /* The free runs are counted (each one is a free block) */
+    while ((g = _scan(_used, g_end, 0)) < _nb_granules) {
+        g_end = _scan(_used, g, 1);
+
+        ++stats->nb_free_blocks;
+
+        if (((g_end - g) << GRANULE_LOG2) > stats->largest_free_sz) {
+            stats->largest_free_sz = (g_end - g) << GRANULE_LOG2;
+        }
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#ifndef H_MALLOC_BITMAP
+#define H_MALLOC_BITMAP
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC_BITMAP
+
+#include "malloc_priv.h"
+
+
+/* Granules structure :
+ * - the heap is split into granules of CONFIG_STD_MALLOC_BITMAP_GRANULE bytes, and
+ *   a block is a run of granules, its data starting at the first one (blocks have
+ *   no header, and free blocks are neither linked nor merged)
+ * - three bitmaps hold one bit per granule: allocated granules, last granule of
+ *   each allocated block and first granule of each sensitive block
+ * - the bitmaps are kept out of the heap, so that an overflow of an allocated
+ *   block cannot corrupt them
+ * - free runs are found by word scans of the allocated granules bitmap, with one
+ *   CTZ instruction (RBIT + CLZ) per run bound
+ */
+
+#define GRANULE_SZ          CONFIG_STD_MALLOC_BITMAP_GRANULE
+
+#if GRANULE_SZ == 16
+# define GRANULE_LOG2       4
+#elif GRANULE_SZ == 32
+# define GRANULE_LOG2       5
+#else
+# error "Bitmap granule must be 16 or 32 bytes"
+#endif
+
+#define MAP_BITS            32
+#define MAP_LOG2            5
+
+#define NB_GRANULES_MAX     ((uint32_t) (CONFIG_STD_MALLOC_BITMAP_HEAP_MAX * 1024) >> GRANULE_LOG2)
+#define NB_WORDS_MAX        ((NB_GRANULES_MAX + MAP_BITS - 1) >> MAP_LOG2)
+
+#define FIRST_BIT(w)        ((uint32_t) __builtin_ctz((uint32_t) (w)))
+
+
+
+/* Chunks management */
+
+#define HDR_SZ              ((u__sz_t) 0)
+#define HDR_FREE_SZ         ((u__sz_t) 0)
+
+#define GRANULE(p)          ((uint32_t) (((physaddr_t) (p) - _start_heap) >> GRANULE_LOG2))
+#define ADDRESS(g)          ((void *) (_start_heap + ((physaddr_t) (g) << GRANULE_LOG2)))
+#define NB_GRANULES(l)      ((uint32_t) (((uint32_t) (l) + GRANULE_SZ - 1) >> GRANULE_LOG2))
+
+#define NOT_GRANULE(p)      (((physaddr_t) (p) - _start_heap) & (GRANULE_SZ - 1))
+
+#define TEST(map,g)         (((map)[(g) >> MAP_LOG2] >> ((g) & (MAP_BITS - 1))) & 1)
+
+
+
+/* Free memory (number of free granules) */
+
+#define SZ_FREE()           ((uint32_t) _nb_free << GRANULE_LOG2)
+
+
+/*
+ * This function should be called by wmalloc_init() once the heap descriptor
+ * has been set, in order to cut the heap into granules and clear the bitmaps
+ */
+int malloc_bitmap_init(void);
+
+#endif
+#endif
@@ -0,0 +1,228 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC
+
+#include "malloc_priv.h"
+
+
+/* Bulk allocation and release structure :
+ * - wmalloc_bulk() and wfree_bulk() work on the default heap, locked once for the
+ *   whole array (the pending releases being done first)
+ * - the allocator carves the n blocks of wmalloc_bulk() into one allocation
+ *   (_wmalloc_bulk_carve()), each block being then counted and traced as allocated
+ * - wfree_bulk() sorts the pointers by address, and splits them into runs of adjacent
+ *   blocks which the allocator can merge (_wmalloc_bulk_next()), each run being
+ *   released as one block (_wmalloc_bulk_free())
+ * - while the heap is locked by another context, wfree_bulk() defers each block as
+ *   wfree() does (_defer(), see malloc_defer.c)
+ */
+
+/* The calls are traced relatively to the default heap */
+#define _start_heap         (heap->start_heap)
+
+
+/* Static functions prototypes */
+static void _sort(void **ptrs, const uint32_t n);
+
+
+/*********************************************************************************************/
+/*  Bulk malloc() function                                                                   */
+/*********************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_bulk(void **ptrs, const uint32_t n, const uint16_t len, const int flag)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_bulk(void **ptrs, const uint32_t n, const uint32_t len, const int flag)
+#endif
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+    uint32_t i;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    /* The default heap is set by the first allocation */
+    LAZY_INIT();
+
+    if (!ptrs) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+    if (!n) {
+        return 0;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Trying to lock of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    if (_wmalloc_bulk_begin(heap, 0) < 0) {
+        goto end_error;
+    }
+
+    /* The n blocks are carved into one allocation */
+    if (_wmalloc_bulk_carve(heap, ptrs, n, (uint32_t) len, flag) < 0) {
+        goto end_error;
+    }
+
+    /* Each successful allocation is counted and traced */
+    _wmalloc_bulk_stats(heap, n, 0, 0);
+
+    for (i = 0; i < n; i++) {
+        TRACE((flag == ALLOC_SENSITIVE ? WMALLOC_TRACE_ALLOC_SENSITIVE : WMALLOC_TRACE_ALLOC),
+              len, ptrs[i]);
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+    /* Failed allocation is counted and traced (once) */
+    _wmalloc_bulk_stats(heap, 0, 0, 1);
+    TRACE_FAILED(WMALLOC_TRACE_ALLOC, len);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+#endif
+
+    return -1;
+}
+
+
+/*********************************************************************************************/
+/*  Bulk free() function                                                                     */
+/*********************************************************************************************/
+int wfree_bulk(void **ptrs, const uint32_t n)
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+    void *ptr           = NULL;
+
+    uint32_t i, j, k;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    if (!ptrs) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+# ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+        /* The blocks are released later by the lock holder */
+        for (i = 0; i < n; i++) {
+            if (ptrs[i] && (_defer(heap, &ptrs[i]) < 0)) {
+                return -1;
+            }
+        }
+
+        return 0;
+# else
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+# endif
+    }
+#endif
+
+    if (_wmalloc_bulk_begin(heap, 1) < 0) {
+        goto end_error;
+    }
+
+    /* The blocks are sorted by address (null pointers first, and skipped), so that
+     * each run of adjacent blocks is released as one block */
+    _sort(ptrs, n);
+
+    for (i = 0; i < n; i = j + 1) {
+
+        j = i;
+
+        if (!ptrs[i]) {
+            continue;
+        }
+
+        /* The run is extended while the next block follows the last one and can be
+         * merged into the first one (the other blocks are checked by the release) */
+        while ((j + 1 < n) && _wmalloc_bulk_next(heap, ptrs[i], ptrs[j], ptrs[j + 1])) {
+            ++j;
+        }
+
+        /* The run is released */
+        ptr = ptrs[i];
+
+        if (_wmalloc_bulk_free(heap, &ptrs[i], j - i + 1) < 0) {
+            goto end_error;
+        }
+
+        /* Each block of the run is counted and traced as released */
+        _wmalloc_bulk_stats(heap, 0, j - i + 1, 0);
+
+        TRACE(WMALLOC_TRACE_FREE, 0, ptr);
+
+        for (k = i + 1; k <= j; k++) {
+            TRACE(WMALLOC_TRACE_FREE, 0, ptrs[k]);
+            ptrs[k] = NULL;
+        }
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+#endif
+
+    return -1;
+}
+
+/*********************************************************************************************/
+/*  Sorting of pointers by address (insertion sort, for short arrays)                        */
+/*********************************************************************************************/
+static void _sort(void **ptrs, const uint32_t n)
+{
+    void *ptr = NULL;
+    uint32_t i, j;
+
+    for (i = 1; i < n; i++) {
+        ptr = ptrs[i];
+
+        for (j = i; (j > 0) && ((physaddr_t) ptrs[j - 1] > (physaddr_t) ptr); j--) {
+            ptrs[j] = ptrs[j - 1];
+        }
+
+        ptrs[j] = ptr;
+    }
+}
+
+#endif
@@ -0,0 +1,215 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+
+#include "malloc_priv.h"
+
+#ifdef CONFIG_ARCH_ARMV7M
+# include "arch/cores/armv7-m/m4_syscall.h"
+#else
+# error "Unknown architecture"
+#endif
+
+
+/* Cache structure :
+ * - each execution context (the main thread, and each ISR slot, the ISRs being
+ *   dispatched on the slots by their irq) owns a cache holding, for each size
+ *   class, up to CONFIG_STD_MALLOC_CACHE_DEPTH blocks released by wfree()
+ * - a class holds the blocks whose data length is in [8 * c, 8 * c + 7], so that
+ *   any of them can be given for a length in [8 * c - 7, 8 * c]
+ * - a cache is only read and written by its own context, and the ISRs of a task
+ *   are executed one at a time: a cache does not need any locking
+ * - the cached blocks are still allocated for the heap (they are counted as used
+ *   by wmalloc_stats()), only normal blocks are cached (sensitive blocks must be
+ *   wiped by wfree())
+ * - when the class of a released block is full, the block is given back to the
+ *   heap, and wmalloc_cache_flush() gives back all the blocks of a context
+ */
+
+#define CACHE_GRAIN         8
+#define CACHE_NB_CLASSES    (CONFIG_STD_MALLOC_CACHE_MAX / CACHE_GRAIN)
+#define CACHE_DEPTH         CONFIG_STD_MALLOC_CACHE_DEPTH
+#define CACHE_NB_CTX        (1 + CONFIG_STD_MALLOC_CACHE_ISR_SLOTS)
+
+struct cache {
+    void     *blocks[CACHE_NB_CLASSES][CACHE_DEPTH];
+    uint8_t   nb[CACHE_NB_CLASSES];         /* Number of blocks of each class */
+    uint8_t   flushing;                     /* Set while giving the blocks back to the heap */
+    struct wmalloc_cache_stats stats;
+};
+
+
+/* Global variables */
+
+static struct cache _caches[CACHE_NB_CTX];
+
+
+/* Static functions prototypes */
+static struct cache *_cache_ctx(void);
+
+
+
+/*********************************************************************************************/
+/*  Cache of the calling context (NULL if the context has no cache)                         */
+/*********************************************************************************************/
+static struct cache *_cache_ctx(void)
+{
+    int32_t irq = __current_isr;
+
+    if (irq < 0) {
+        return &_caches[WMALLOC_CACHE_MAIN];
+    }
+
+#if CONFIG_STD_MALLOC_CACHE_ISR_SLOTS > 0
+    return &_caches[1 + ((uint32_t) irq % CONFIG_STD_MALLOC_CACHE_ISR_SLOTS)];
+#else
+    return NULL;
+#endif
+}
+
+/*********************************************************************************************/
+/*  Allocation from the cache (0 if allocated, 1 if it must go through the heap)            */
+/*********************************************************************************************/
+int _wmalloc_cache_get(void **ptr_to_alloc, const uint32_t len, const int flag)
+{
+    struct cache *cache = _cache_ctx();
+    uint32_t c          = (len + CACHE_GRAIN - 1) / CACHE_GRAIN;
+
+    /* Errors (flag, pointer already set) are left to the heap path */
+    if (!cache || (flag != ALLOC_NORMAL) || !c || (c > CACHE_NB_CLASSES)) {
+        return 1;
+    }
+
+#if CONFIG_STD_MALLOC_CHECK_IF_NULL == 1
+    if (*ptr_to_alloc) {
+        return 1;
+    }
+#endif
+
+    if (!cache->nb[c - 1]) {
+        ++cache->stats.nb_misses;
+        return 1;
+    }
+
+    --cache->nb[c - 1];
+    --cache->stats.nb_blocks;
+    ++cache->stats.nb_hits;
+
+    /* As for the heap, the data of a normal block are not blanked */
+    *ptr_to_alloc = cache->blocks[c - 1][cache->nb[c - 1]];
+
+    malloc_errno = 0;
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Release into the cache (0 if kept, 1 if it must go through the heap, -1 on error)       */
+/*********************************************************************************************/
+int _wmalloc_cache_put(void **ptr_to_free)
+{
+    struct cache *cache = _cache_ctx();
+    uint32_t c;
+    uint32_t i, j;
+
+    if (!cache || cache->flushing) {
+        return 1;
+    }
+
+    /* The allocator checks the block as far as it can without locking */
+    c = _wmalloc_cache_len(*ptr_to_free) / CACHE_GRAIN;
+
+    if (!c || (c > CACHE_NB_CLASSES)) {
+        return 1;
+    }
+
+    /* A cached block is still allocated for the heap: a second release is detected here
+     * (a block released twice by two contexts is only detected out of their ISRs) */
+    for (i = 0; i < CACHE_NB_CTX; i++) {
+        for (j = 0; j < _caches[i].nb[c - 1]; j++) {
+            if (_caches[i].blocks[c - 1][j] == *ptr_to_free) {
+                malloc_errno = EHEAPALREADYFREE;
+                return -1;
+            }
+        }
+    }
+
+    if (cache->nb[c - 1] == CACHE_DEPTH) {
+        ++cache->stats.nb_overflows;
+        return 1;
+    }
+
+    cache->blocks[c - 1][cache->nb[c - 1]] = *ptr_to_free;
+    ++cache->nb[c - 1];
+    ++cache->stats.nb_blocks;
+    ++cache->stats.nb_cached;
+
+    *ptr_to_free = NULL;
+
+    malloc_errno = 0;
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Release of the cached blocks of the calling context                                      */
+/*********************************************************************************************/
+int wmalloc_cache_flush(void)
+{
+    struct cache *cache = _cache_ctx();
+    void *ptr = NULL;
+    uint32_t c;
+
+    if (!cache) {
+        return 0;
+    }
+
+    /* wfree() does not cache the blocks anymore until the end of the flush */
+    cache->flushing = 1;
+
+    for (c = 0; c < CACHE_NB_CLASSES; c++) {
+        while (cache->nb[c]) {
+            ptr = cache->blocks[c][cache->nb[c] - 1];
+
+            /* On error (e.g. wmalloc usage locked), the block stays cached */
+            if (wfree(&ptr) < 0) {
+                cache->flushing = 0;
+                return -1;
+            }
+
+            --cache->nb[c];
+            --cache->stats.nb_blocks;
+        }
+    }
+
+    cache->flushing = 0;
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Counters of a context cache                                                              */
+/*********************************************************************************************/
+int wmalloc_cache_stats(const uint32_t ctx, struct wmalloc_cache_stats *stats)
+{
+    if (!stats) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+    if (ctx >= CACHE_NB_CTX) {
+        malloc_errno = EHEAPPARAM;
+        return -1;
+    }
+
+    *stats = _caches[ctx].stats;
+
+    return 0;
+}
+
+#endif
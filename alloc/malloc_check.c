@@ -0,0 +1,87 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#if defined(CONFIG_STD_MALLOC_STD) || defined(CONFIG_STD_MALLOC_BINS) || defined(CONFIG_STD_MALLOC_TLSF)
+
+#include "malloc_priv.h"
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+
+
+/* Incremental checking structure :
+ * - the headers of the next budget blocks (in addresses order) are checked from
+ *   the cursor of the heap descriptor, which is kept between calls (offset of the
+ *   next header to check, 0 for b_0)
+ * - a pass over the heap starts with b_0 and ends with the last block, so that all
+ *   headers are checked within (number of blocks + 1) / budget calls
+ * - the allocator gives the check of one header (_check_block(), which also gives
+ *   the offset of the next one), and moves the cursor (CHECK_CURSOR_MOVE()) when the
+ *   header it points to vanishes (merged block)
+ */
+
+
+/*********************************************************************************************/
+/*  Checking of the next budget headers (wmalloc usage must be locked)                       */
+/*********************************************************************************************/
+int _check_step(struct wheap *heap, uint32_t budget)
+{
+    u_off_t nxt = 0;
+    int error   = 0;
+
+    while (budget--) {
+        if ((error = _check_block(heap, heap->check_cursor, &nxt))) {
+            return error;
+        }
+        heap->check_cursor = nxt;
+    }
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Incremental checking of the default heap's integrity                                     */
+/*********************************************************************************************/
+int wmalloc_check_step(const uint32_t budget)
+{
+    struct wheap *heap = _get_wmalloc_heap();
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    if (_check_step(heap, budget) < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+#endif
+
+    return -1;
+}
+
+#endif
+#endif
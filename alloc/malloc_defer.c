@@ -0,0 +1,149 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC
+
+#include "malloc_priv.h"
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+
+
+/* Deferred release structure :
+ * - a block given to wfree() while wmalloc usage is locked is pushed on the pending
+ *   list of its heap (lock-free, linked by the first word of its data), after the
+ *   checks which do not need the lock (_wmalloc_defer_check())
+ * - the second word of its data is marked while it is pending, so that a block given
+ *   twice to wfree() is refused before its link is overwritten (which would lose the
+ *   blocks pushed before it)
+ * - the next lock holder takes the whole list and releases each block
+ *   (_wmalloc_defer_free()), the blocks which cannot be released being counted
+ *   (_wmalloc_defer_stats(), see wmalloc_stats()) without failing the calling function
+ */
+
+/* The releases are traced relatively to the heap */
+#define _start_heap         (heap->start_heap)
+
+
+/*********************************************************************************************/
+/*  Deferred release (wmalloc usage locked by another thread or an interrupted one)          */
+/*********************************************************************************************/
+int _defer(struct wheap *heap, void **ptr_to_free)
+{
+    /* Only the checks which do not need wmalloc usage to be locked are done here, the
+     * headers being checked when the block is really released */
+    if (!(*ptr_to_free)) {
+        malloc_errno = EHEAPALREADYFREE;
+        return -1;
+    }
+
+    if (_wmalloc_defer_check(heap, *ptr_to_free) < 0) {
+        return -1;
+    }
+
+    /* A block already pending is refused */
+    if (IS_PENDING(*ptr_to_free)) {
+        malloc_errno = EHEAPALREADYFREE;
+        return -1;
+    }
+
+    /* The block is marked, and pushed on the pending list, linked by the first word of
+     * its data */
+    MAKE_PENDING(*ptr_to_free);
+
+    core_lifo_push(&heap->pending, *ptr_to_free);
+
+    *ptr_to_free = NULL;
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Release of the pending blocks (wmalloc usage must be locked)                             */
+/*********************************************************************************************/
+uint32_t _drain(struct wheap *heap)
+{
+    void *ptr = core_lifo_take(&heap->pending);
+    void *nxt = NULL;
+    uint32_t nb_frees = 0;
+    uint32_t nb_bad = 0;
+
+    while (ptr) {
+        /* A block found free or not marked (or a link out of the heap) ends the list,
+         * whose links cannot be trusted anymore (data overwritten after wfree()) */
+        if ((_wmalloc_defer_check(heap, ptr) < 0) || !IS_PENDING(ptr)) {
+            ++nb_bad;
+            break;
+        }
+
+        /* The link is read and the mark cleared before the block is released (and its
+         * data overwritten) */
+        nxt = PENDING_NXT(ptr);
+
+        CLEAR_PENDING(ptr);
+
+        /* A block which cannot be released (e.g. bad header) is counted and left, the
+         * next ones being released anyway */
+        if (_wmalloc_defer_free(heap, ptr) < 0) {
+            ++nb_bad;
+        } else {
+            ++nb_frees;
+            TRACE(WMALLOC_TRACE_FREE, 0, ptr);
+        }
+
+        ptr = nxt;
+    }
+
+    _wmalloc_defer_stats(heap, nb_frees, nb_bad);
+
+    if (nb_bad) {
+        /* The error is not the one of the calling function */
+        malloc_errno = 0;
+    }
+
+    return nb_bad;
+}
+
+/*********************************************************************************************/
+/*  Release of the pending blocks (freed while wmalloc usage was locked)                     */
+/*********************************************************************************************/
+int wmalloc_drain(void)
+{
+    struct wheap *heap = _get_wmalloc_heap();
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+
+    if (_drain(heap)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+
+    return 0;
+
+end_error:
+
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+
+    return -1;
+}
+
+#endif
+#endif
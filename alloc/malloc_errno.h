@@ -26,6 +26,8 @@ uint32_t malloc_errno;
 #define EHEAPSIZETOOSMALL   150     /* Heap's size is too big (HEAP_SIZE_LEN could be changed) */
 #define EHEAPSIZETOOBIG     151     /* Heap's size is too big (HEAP_SIZE_LEN could be changed) */
 #define EHEAPSIZENOTALIGNED 152     /* Heap's size not aligned (HEAP_ALIGN could be changed) */
+#define EHEAPPARAM          153     /* Heap handle or region not valid */
+#define EHEAPALIGN          154     /* Alignment not a power of two */
 
 #define EMEMDESTNULL        160     /* Destination pointer null */
 #define EMEMHEAPUNDERFLOW   161     /* Execution would cause a heap underflow */
@@ -34,6 +36,11 @@ uint32_t malloc_errno;
 
 #define EPROTECNOTACTIVE    170     /* Selected protection was not activated */
 
+#define EPOOLPARAM          190     /* Pool parameters not valid */
+#define EPOOLEMPTY          191     /* No more free object in pool */
+
+#define EARENAPARAM         195     /* Arena parameters not valid */
+
 #define ESTRTOLBASE         180     /* Base unexpected */
 #define ESTRTOLLONG         181     /* String too long to be converted into integer */
 #define ESTRTOLBADCHAR      182     /* String contains unconvertible characters */
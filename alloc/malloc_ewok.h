@@ -13,6 +13,29 @@
 #include "malloc_priv.h"
 
 
+/* OPTIONS **********************************************************************/
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+# define CANARIS_INTEGRITY          1
+# define FREE_PTR_INTEGRITY         0
+# define SZ_VAL_INTEGRITY           0
+# define HEADERS_INTER_CONSISTENCY  0
+# define CHECK_NB_AND_SZ            1
+# define SUM_VERSION                2
+#endif
+
+#define HEAP_SIZE_LEN               CONFIG_STD_MALLOC_SIZE_LEN
+#define STD_FREEMEM_CHECK           CONFIG_STD_MALLOC_FREEMEM_CHECK
+
+/* Usual production configuration (16 bits sizes, integrity level 1): the flag and the
+ * canaries of a header are checked by one inlined test, check_hdr() being called only
+ * for giving the error */
+#if (CONFIG_STD_MALLOC_INTEGRITY == 1) && (HEAP_SIZE_LEN == 16)
+# define FAST_HDR_CHECK             1
+#endif
+
+/********************************************************************************/
+
 
 /* Chunk structure :
  * - size and and previous chunk's size
@@ -160,6 +183,27 @@ struct __attribute__((packed)) alloc_block {
 #endif
 
 
+/* Headers checking (the valid flags are 0x0000, 0x0101, 0xFEFE and 0xFFFF: both bytes
+ * are equal, and the low one plus 2 is lower than 4) */
+
+#if FAST_HDR_CHECK == 1
+
+# define BAD_FLAG_FAST(b)       ((((b)->flag ^ ((b)->flag >> 8)) & 0xFF) | \
+                                 ((uint8_t) ((b)->flag + 2) & 0xFC))
+
+# define BAD_HDR(b)             (BAD_FLAG_FAST(b) | \
+                                 ((b)->can_sz ^ CANARI_SZ(b)) | \
+                                 (IS_FREE(b) ? ((b)->can_free ^ CANARI_FREE(b)) : 0))
+
+# define CHECK_HDR(h,b,f)       (BAD_HDR(b) ? check_hdr((h), (b), (f)) : 0)
+
+#else
+
+# define CHECK_HDR(h,b,f)       check_hdr((h), (b), (f))
+
+#endif
+
+
 
 /* Bock 0 management */
 
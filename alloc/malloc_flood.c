@@ -0,0 +1,77 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC
+
+#include "malloc_priv.h"
+
+
+/* Secure flooding :
+ * - used for wiping sensitive blocks (and headers) by all the allocators, so
+ *   that secrets do not stay into freed memory
+ * - the stores go through volatile pointers, so that the compiler can neither
+ *   remove them (dead stores before a free) nor turn the loops into a call
+ *   to memset(); it can still be compiled with the other optimizations
+ * - the unaligned head and tail are written by bytes, and the body by words
+ *   (four words per loop turn)
+ */
+
+#define FLOOD_WORD          ((uint32_t) sizeof(uint32_t))
+#define FLOOD_MASK          ((physaddr_t) (FLOOD_WORD - 1))
+
+
+/*********************************************************************************************/
+/*  Flooding function (secure)                                                               */
+/*********************************************************************************************/
+void *_safe_flood_char(void *dest, const char c, uint32_t n)
+{
+    volatile uint8_t  *byte = (volatile uint8_t *) dest;
+    volatile uint32_t *word = NULL;
+
+    const uint32_t pattern  = (uint32_t) ((uint8_t) c) * 0x01010101;
+
+    /* Head, up to the first aligned word */
+    while (n && ((physaddr_t) byte & FLOOD_MASK)) {
+        *byte = (uint8_t) c;
+        ++byte;
+        --n;
+    }
+
+    /* Body */
+    word = (volatile uint32_t *) byte;
+
+    while (n >= 4 * FLOOD_WORD) {
+        word[0] = pattern;
+        word[1] = pattern;
+        word[2] = pattern;
+        word[3] = pattern;
+        word += 4;
+        n -= 4 * FLOOD_WORD;
+    }
+
+    while (n >= FLOOD_WORD) {
+        *word = pattern;
+        ++word;
+        n -= FLOOD_WORD;
+    }
+
+    /* Tail */
+    byte = (volatile uint8_t *) word;
+
+    while (n) {
+        *byte = (uint8_t) c;
+        ++byte;
+        --n;
+    }
+
+    /* Compiler fence: the flooded memory is seen as read from here */
+    __asm__ volatile ("" : : "r" (dest) : "memory");
+
+    return dest;
+}
+
+#endif
@@ -19,25 +19,30 @@ extern uint32_t _s_stack;
 extern uint32_t _e_stack;
 extern uint32_t numslots;
 
-/* Heap specifications */
-static physaddr_t _start_heap;
-static physaddr_t _end_heap;
-static u__sz_t    _heap_size;
+/* Default heap (the one of the wmalloc() functions) */
+static struct wheap _heap;
 
-#if CONFIG_STD_MALLOC_INTEGRITY >= 1
-/* Canaries (random or not) */
-static u_can_t _can_sz;
-static u_can_t _can_free;
+/* Set once the default heap is initialized */
+static volatile uint32_t _heap_ready;
+
+#if defined(CONFIG_STD_MALLOC_LAZY_INIT) && defined(CONFIG_STD_MALLOC_MUTEX)
+/* Lock of the lazy initialization (free at startup) */
+static volatile uint32_t _init_lock = 1;
 #endif
 
-#ifdef CONFIG_STD_MALLOC_MUTEX
-/* Semaphore */
-static volatile uint32_t _semaphore;
+/* Specifications of the heap being initialized (for the blocks macros) */
+#define _start_heap         (heap->start_heap)
+#define _end_heap           (heap->end_heap)
+#define _heap_size          (heap->heap_size)
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+# define _can_sz            (heap->can_sz)
+# define _can_free          (heap->can_free)
 #endif
 
 
 /* Static functions prototypes */
-static int _wmalloc_init(physaddr_t const task_start_heap, uint32_t const task_heap_size);
+static void _task_heap(physaddr_t *task_start_heap, uint32_t *task_heap_size);
+static int _wheap_init(struct wheap *heap, physaddr_t const task_start_heap, uint32_t const task_heap_size);
 
 
 /****************************************************************************************/
@@ -48,9 +53,9 @@ static int _wmalloc_init(physaddr_t const task_start_heap, uint32_t const task_h
 /* Set heap specifications for allocator functions */
 void _set_wmalloc_heap(physaddr_t *start_heap, physaddr_t *end_heap, u__sz_t *heap_size)
 {
-    *start_heap = _start_heap;
-    *end_heap   = _end_heap;
-    *heap_size  = _heap_size;
+    *start_heap = _heap.start_heap;
+    *end_heap   = _heap.end_heap;
+    *heap_size  = _heap.heap_size;
 
     return;
 }
@@ -60,19 +65,26 @@ void _set_wmalloc_heap(physaddr_t *start_heap, physaddr_t *end_heap, u__sz_t *he
 /* Set heap specifications for allocator functions */
 void _set_wmalloc_canaries(u_can_t *can_sz, u_can_t *can_free)
 {
-    *can_sz   = _can_sz;
-    *can_free = _can_free;
+    *can_sz   = _heap.can_sz;
+    *can_free = _heap.can_free;
 
     return;
 }
 #endif
 
 
+/* Get the default heap descriptor for allocator functions */
+struct wheap *_get_wmalloc_heap(void)
+{
+    return &_heap;
+}
+
+
 #ifdef CONFIG_STD_MALLOC_MUTEX
 /* Set semaphore for allocator functions */
 void _set_wmalloc_semaphore(volatile uint32_t *ptr_semaphore)
 {
-    *ptr_semaphore = (physaddr_t) (&_semaphore);
+    *ptr_semaphore = (physaddr_t) (&_heap.semaphore);
 
     return;
 }
@@ -87,17 +99,91 @@ int wmalloc_init(void)
     physaddr_t task_start_heap = 0;
     uint32_t   task_heap_size  = 0;
 
-#ifdef CONFIG_KERNEL_EWOK
-    task_start_heap = (physaddr_t) (&_e_bss);
+#if defined(CONFIG_STD_MALLOC_LIGHT) || defined(CONFIG_STD_MALLOC_STD)
+    /* heap specifications are read by the allocator functions from the heap descriptor */
+#elif defined(CONFIG_STD_MALLOC_BINS) || defined(CONFIG_STD_MALLOC_TLSF)
+    /* segregated lists are initialized once the initial blocks are set (see below) */
+#elif defined(CONFIG_STD_MALLOC_BITMAP)
+    /* bitmaps are cleared once the heap descriptor is set (see below) */
+#else
+# error "init for other malloc not done yet"
+#endif
 
-    task_heap_size  = (uint32_t) (((uint32_t) CONFIG_RAM_SLOT_SIZE * (uint32_t) &numslots) - \
-                                  ((uint32_t) &_e_stack - (uint32_t) &_s_stack) - \
-                                  ((uint32_t) &_e_data  - (uint32_t) &_s_data) - \
-                                  ((uint32_t) &_e_bss   - (uint32_t) &_s_bss));
-#if 1 /* for debug purpose */
-    printf("heap start: 0x%08x\n", task_start_heap);
-    printf("heap size: 0x%06x\n", task_heap_size);
-    printf("num slots: 0x%02d\n", &numslots);
+    /* Nothing is printed here (see wmalloc_dump_layout()), and only the headers of
+     * the initial blocks are written: the setup does not depend on the heap size */
+    _task_heap(&task_start_heap, &task_heap_size);
+
+    /* If no kernel specified... */
+    if ((!task_start_heap) || (!task_heap_size)) {
+        return -1;
+    }
+
+    if (_wheap_init(&_heap, task_start_heap, task_heap_size) < 0) {
+        return -1;
+    }
+
+#if defined(CONFIG_STD_MALLOC_BINS)
+    malloc_bins_init();
+#elif defined(CONFIG_STD_MALLOC_TLSF)
+    malloc_tlsf_init();
+#elif defined(CONFIG_STD_MALLOC_BITMAP)
+    if (malloc_bitmap_init() < 0) {
+        return -1;
+    }
+#endif
+
+    _heap_ready = 1;
+
+    return 0;
+}
+
+
+#ifdef CONFIG_STD_MALLOC_LAZY_INIT
+/****************************************************************************************/
+/*  Initialization of the default heap at the first allocation                          */
+/****************************************************************************************/
+int _wmalloc_lazy_init(void)
+{
+    int ret = 0;
+
+    if (_heap_ready) {
+        return 0;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* An allocation interrupting the initialization fails as on a locked heap */
+    if (!semaphore_trylock(&_init_lock)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    /* The heap may have been set meanwhile by the previous lock holder */
+    if (!_heap_ready) {
+        ret = wmalloc_init();
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    semaphore_release(&_init_lock);
+#endif
+
+    return ret;
+}
+#endif
+
+
+/****************************************************************************************/
+/*  Print of the task memory layout and of the default heap                             */
+/****************************************************************************************/
+int wmalloc_dump_layout(void)
+{
+    physaddr_t task_start_heap = 0;
+    uint32_t   task_heap_size  = 0;
+
+    _task_heap(&task_start_heap, &task_heap_size);
+
+#ifdef CONFIG_KERNEL_EWOK
+    printf("num slots: %d\n", (uint32_t) &numslots);
     printf("data start: 0x%08x\n", &_s_data);
     printf("data end: 0x%08x\n", &_e_data);
     printf("bss start: 0x%08x\n", &_s_bss);
@@ -105,35 +191,89 @@ int wmalloc_init(void)
     printf("stack start: 0x%08x\n", &_s_stack);
     printf("stack end: 0x%08x\n", &_e_stack);
 #endif
+    printf("heap start: 0x%08x\n", task_start_heap);
+    printf("heap size: 0x%06x\n", task_heap_size);
 
-#ifdef CONFIG_STD_MALLOC_LIGHT
-    malloc_light_init(task_start_heap, (physaddr_t)task_start_heap + task_heap_size, (u__sz_t)task_heap_size);
-#else
-# error "init for other malloc not done yet"
-#endif
+    /* The allocator may use a part of the task heap only (alignment, size limits) */
+    if (_heap_ready) {
+        printf("wmalloc heap: 0x%08x - 0x%08x\n", _heap.start_heap, _heap.end_heap);
+    } else {
+        printf("wmalloc heap: not initialized\n");
+    }
+
+    return 0;
+}
 
+
+/****************************************************************************************/
+/*  Task heap (the RAM slots left by the data, bss and stack sections)                  */
+/****************************************************************************************/
+static void _task_heap(physaddr_t *task_start_heap, uint32_t *task_heap_size)
+{
+#ifdef CONFIG_KERNEL_EWOK
+    *task_start_heap = (physaddr_t) (&_e_bss);
+
+    *task_heap_size  = (uint32_t) (((uint32_t) CONFIG_RAM_SLOT_SIZE * (uint32_t) &numslots) - \
+                                   ((uint32_t) &_e_stack - (uint32_t) &_s_stack) - \
+                                   ((uint32_t) &_e_data  - (uint32_t) &_s_data) - \
+                                   ((uint32_t) &_e_bss   - (uint32_t) &_s_bss));
 #else
 # error "not a supported allocator backend"
 #endif
 
-    /* If no kernel specified... */
-    if ((!task_start_heap) || (!task_heap_size)) {
+    return;
+}
+
+
+#if defined(CONFIG_STD_MALLOC_LIGHT) || defined(CONFIG_STD_MALLOC_STD)
+/****************************************************************************************/
+/*  Initialization of a heap handle                                                     */
+/****************************************************************************************/
+int wheap_init(wheap_t **heap, void *region, const uint32_t size)
+{
+    physaddr_t start = (physaddr_t) region;
+    physaddr_t end   = (physaddr_t) region + size;
+
+    if (!heap) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+    if (!region || (end < start)) {
+        malloc_errno = EHEAPPARAM;
+        return -1;
+    }
+
+    /* The descriptor is stored at the start of the region (aligned), the heap follows it */
+    start = (start + 7) & ~((physaddr_t) 7);
+
+    if (start + WHEAP_DESC_SZ > end) {
+        malloc_errno = EHEAPSIZETOOSMALL;
         return -1;
     }
 
-    return _wmalloc_init(task_start_heap, task_heap_size);
+    if (_wheap_init((struct wheap *) start, start + WHEAP_DESC_SZ, end - start - WHEAP_DESC_SZ) < 0) {
+        return -1;
+    }
+
+    *heap = (wheap_t *) start;
+
+    return 0;
 }
+#endif
 
 
 /****************************************************************************************/
-/*  Initialization of heap global variables                                             */
+/*  Initialization of a heap descriptor                                                 */
 /****************************************************************************************/
-static int _wmalloc_init(const physaddr_t task_start_heap, const uint32_t task_heap_size)
+static int _wheap_init(struct wheap *heap, const physaddr_t task_start_heap, const uint32_t task_heap_size)
 {
     uint32_t heap_size_tmp = task_heap_size;
 
+#ifndef CONFIG_STD_MALLOC_BITMAP
     struct block *b_0 = NULL;
     struct block *b_1 = NULL;
+#endif
 
     malloc_errno = 0;
 
@@ -143,28 +283,46 @@ static int _wmalloc_init(const physaddr_t task_start_heap, const uint32_t task_h
         malloc_errno = EHEAPSIZETOOBIG;
         return -1;
     }
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+    /* The heap end must not wrap around the address space */
+    if (task_start_heap + heap_size_tmp < task_start_heap) {
+        malloc_errno = EHEAPSIZETOOBIG;
+        return -1;
+    }
 #endif
 
 #if CONFIG_STD_MALLOC_ALIGN > 1
     heap_size_tmp = ALIGN(heap_size_tmp);
 #endif
 
+#ifdef CONFIG_STD_MALLOC_BITMAP
+    if (heap_size_tmp < GRANULE_SZ) {
+#else
     if (heap_size_tmp < 2 * HDR_FREE_SZ) {
+#endif
         malloc_errno = EHEAPSIZETOOSMALL;
         return -1;
     }
 
-    /* Static global variables are set */
+    /* Heap descriptor is set */
     _start_heap = (physaddr_t) task_start_heap;
     _heap_size  = (u__sz_t)    task_heap_size;
     _end_heap   = (physaddr_t) (task_start_heap + task_heap_size);
 
+    memset(&heap->stats, 0, sizeof(heap->stats));
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+    heap->check_cursor = 0;
+#endif
+#ifdef CONFIG_STD_MALLOC_NEXT_FIT
+    heap->roving       = 0;
+#endif
+
 #ifdef CONFIG_STD_MALLOC_MUTEX
     /* Locking of wmalloc usage */
-    semaphore_init(1, &_semaphore);
+    semaphore_init(1, &heap->semaphore);
 
     /* Trying to lock of wmalloc usage */
-    if (!semaphore_trylock(&_semaphore)) {
+    if (!semaphore_trylock(&heap->semaphore)) {
         malloc_errno = EHEAPLOCKED;
         return -1;
     }
@@ -182,6 +340,7 @@ static int _wmalloc_init(const physaddr_t task_start_heap, const uint32_t task_h
 # endif
 #endif
 
+#ifndef CONFIG_STD_MALLOC_BITMAP
     /* Definition of the initial block of the heap */
     b_0             = (struct block *) _start_heap;
 
@@ -207,10 +366,11 @@ static int _wmalloc_init(const physaddr_t task_start_heap, const uint32_t task_h
 # if CANARIS_INTEGRITY == 1
     UPDATE_CANARI_BOTH(b_1);
 # endif
+#endif
 
 #ifdef CONFIG_STD_MALLOC_MUTEX
     /* Unlocking of wmalloc usage */
-    if (!semaphore_release(&_semaphore)) {
+    if (!semaphore_release(&heap->semaphore)) {
         malloc_errno = EHEAPSEMAPHORE;
         return -1;
     }
@@ -1,5 +1,5 @@
-#ifndef H_MALLOC_EWOK
-#define H_MALLOC_EWOK
+#ifndef H_MALLOC_INIT
+#define H_MALLOC_INIT
 
 #include "autoconf.h"
 
@@ -12,6 +12,8 @@ int wmalloc_init(void);
 
 void _set_wmalloc_heap(physaddr_t *start_heap, physaddr_t *end_heap, u__sz_t *heap_size);
 
+struct wheap *_get_wmalloc_heap(void);
+
 #if CONFIG_STD_MALLOC_INTEGRITY >= 1
 void _set_wmalloc_canaries(u_can_t *can_sz, u_can_t *can_free);
 #endif
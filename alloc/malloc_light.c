@@ -15,49 +15,129 @@
 
 /* Global variables */
 
-/* Heap specifications */
-static physaddr_t _start_heap;
-static physaddr_t _end_heap;
-static u__sz_t    _heap_size;
-
-#ifdef CONFIG_STD_MALLOC_MUTEX
-/* Semaphore */
-volatile uint32_t _ptr_semaphore;
+/* Heap specifications and state (fields of the heap descriptor given to each function:
+ * default heap or heap handle) */
+#define _start_heap         (heap->start_heap)
+#define _end_heap           (heap->end_heap)
+#define _heap_size          (heap->heap_size)
+#define _stats              (heap->stats)
+
+#ifdef CONFIG_STD_MALLOC_NEXT_FIT
+# define _roving            (heap->roving)
 #endif
 
 
 /* Static functions prototypes */
-static int _update_inter_free(struct block *b_cur, struct block *b_nxt_int, u__sz_t cur_free_sz);
-static int _unlink(struct block *b_cur);
-static int _link(struct block *b_cur, struct block *b_0);
+static int _alloc(struct wheap *heap, void **ptr_to_alloc, const u__sz_t len, const int flag);
+static void _carve(struct wheap *heap, struct block *b_cur, const u__sz_t sz, const uint32_t n, void **ptrs);
+static int _mergeable(struct wheap *heap, struct block *b_cur, struct block *b);
+static void _merge(struct wheap *heap, struct block *b_cur, struct block *b_lst);
+static int _free(struct wheap *heap, void **ptr_to_free);
+static int _update_inter_free(struct wheap *heap, struct block *b_cur, struct block *b_nxt_int, u__sz_t cur_free_sz);
+static int _unlink(struct wheap *heap, struct block *b_cur);
+static int _link(struct wheap *heap, struct block *b_cur, struct block *b_0);
+static int _resize(struct wheap *heap, struct block *b_cur, u__sz_t sz);
+
+#ifdef CONFIG_STD_MALLOC_BEST_FIT
+static struct block *_best_fit(struct wheap *heap, struct block *b_0, u__sz_t sz);
+#endif
 
-static void *_safe_flood_char(void *dest, const char c, uint32_t n);
 
-/*
- * This function should be called by malloc_init() to
- * initialize local heap informations
- */
-void malloc_light_init(physaddr_t start_heap,
-                       physaddr_t end_heap,
-                       u__sz_t    heap_size)
+/*********************************************************************************************/
+/*  Malloc() function (default heap)                                                         */
+/*********************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc(void **ptr_to_alloc, const uint16_t len, const int flag)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
+#endif
 {
-    _start_heap = start_heap;
-    _end_heap = end_heap;
-    _heap_size = heap_size;
+    /* The default heap is set by the first allocation */
+    LAZY_INIT();
 
-#ifdef CONFIG_STD_MALLOC_MUTEX
-    _set_wmalloc_semaphore((uint32_t *) _ptr_semaphore);
+#ifdef CONFIG_STD_MALLOC_CACHE
+    /* Small blocks are first taken from the cache of the calling context (no locking) */
+    if (!_wmalloc_cache_get(ptr_to_alloc, (uint32_t) len, flag)) {
+        return 0;
+    }
 #endif
+
+    return wheap_alloc(_get_wmalloc_heap(), ptr_to_alloc, len, flag);
 }
 
 /*********************************************************************************************/
-/*  Malloc() function                                                                        */
+/*  Malloc() function (given heap)                                                           */
 /*********************************************************************************************/
 #if CONFIG_STD_MALLOC_SIZE_LEN == 16
-int wmalloc(void **ptr_to_alloc, const uint16_t len, const int flag)
+int wheap_alloc(wheap_t *heap, void **ptr_to_alloc, const uint16_t len, const int flag)
 #elif CONFIG_STD_MALLOC_SIZE_LEN == 32
-int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
+int wheap_alloc(wheap_t *heap, void **ptr_to_alloc, const uint32_t len, const int flag)
+#endif
+{
+    struct block *b_0   = NULL;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    if (!heap) {
+        malloc_errno = EHEAPPARAM;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Trying to lock of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
 #endif
+
+    /* The block is allocated */
+    if (_alloc(heap, ptr_to_alloc, (u__sz_t) len, flag) < 0) {
+        goto end_error;
+    }
+
+    /* Successful allocation is counted and traced */
+    b_0 = (struct block *) _start_heap;
+    STATS_ALLOC();
+    TRACE((flag == ALLOC_SENSITIVE ? WMALLOC_TRACE_ALLOC_SENSITIVE : WMALLOC_TRACE_ALLOC),
+          len, *ptr_to_alloc);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+    /* Failed allocation is counted and traced */
+    STATS_FAILED();
+    TRACE_FAILED(WMALLOC_TRACE_ALLOC, len);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+#endif
+
+    return -1;
+}
+
+/*********************************************************************************************/
+/*  Allocation of a block (wmalloc usage must be locked)                                     */
+/*********************************************************************************************/
+static int _alloc(struct wheap *heap, void **ptr_to_alloc, const u__sz_t len, const int flag)
 {
     void *ptr                   = NULL;
 
@@ -65,8 +145,8 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
     u__sz_t sz                  = 0;
     u__sz_t cur_free_sz         = 0;
 
-    struct block *b_0 = (struct block *) _start_heap;
-    struct block *b_cur         = NXT_FREE(b_0);
+    struct block *b_0           = NULL;
+    struct block *b_cur         = NULL;
     struct block *b_nxt_now     = NULL;
     struct block *b_nxt_int     = NULL;
 
@@ -74,20 +154,14 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
 
     int32_t random = 0;
 
-    /* Errno is initialized to zero */
-    malloc_errno = 0;
-
-#ifdef CONFIG_STD_MALLOC_MUTEX
-    /* Trying to lock of wmalloc usage */
-    if (!semaphore_trylock(&_ptr_semaphore)) {
-        malloc_errno = EHEAPLOCKED;
-        return -1;
-    }
+    b_0   = (struct block *) _start_heap;
+#ifdef CONFIG_STD_MALLOC_NEXT_FIT
+    /* Next fit: the search starts where the previous allocation ended */
+    b_cur = BLOCK(_roving);
+#else
+    b_cur = NXT_FREE(b_0);
 #endif
 
-    /* Getting of heap specification values */
-    //_set_wmalloc_heap(&_start_heap, &_end_heap, &_heap_size);
-
     /* Checking of the validity of the flag */
     if ((flag != ALLOC_NORMAL) && (flag != ALLOC_SENSITIVE)) {
         malloc_errno = EHEAPFLAGNOTVALID;
@@ -101,8 +175,8 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
     }
 
     /* Allocated block cannot be smaller than a free bock header (think free()...) */
-    if (len_bis < (u__sz_t) (HDR_FREE_SZ - HDR_SZ)) {
-        len_bis = (u__sz_t) (HDR_FREE_SZ - HDR_SZ);
+    if (len_bis < (u__sz_t) DATA_MIN_SZ) {
+        len_bis = (u__sz_t) DATA_MIN_SZ;
     }
 
 #if CONFIG_STD_MALLOC_ALIGN > 1
@@ -113,8 +187,19 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
     /* Block size is calculated */
     sz = (u__sz_t) (len_bis + HDR_SZ);
 
+#ifdef CONFIG_STD_MALLOC_BEST_FIT
+    /* Best fit: the smallest fitting free block is first looked for,
+     * then allocated by the first turn of the loop below */
+    if (!(b_cur = _best_fit(heap, b_0, sz))) {
+        malloc_errno = EHEAPNOMEM;
+        goto end_error;
+    }
+#endif
+
     while (1) {
 
+        STATS_SCAN();
+
         /* We check if the current block is large enough */
         if (b_cur->sz >= sz) {
 
@@ -147,14 +232,20 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
              * else "len_bis" was increased) */
             if (cur_free_sz - sz >= HDR_FREE_SZ) {
                 b_nxt_int = (struct block *) ((physaddr_t) b_cur + sz);
-                _update_inter_free(b_cur, b_nxt_int, cur_free_sz);
+                _update_inter_free(heap, b_cur, b_nxt_int, cur_free_sz);
                 insered_block = 1;
+#ifdef CONFIG_STD_MALLOC_NEXT_FIT
+                _roving = OFFSET(b_nxt_int);
+#endif
             } else {
-                if (_unlink(b_cur) < 0) {
+                if (_unlink(heap, b_cur) < 0) {
                     malloc_errno = EHEAPNODEF;
                     goto end_error;
                 }
                 DECREASE_NB_FREE();
+#ifdef CONFIG_STD_MALLOC_NEXT_FIT
+                _roving = b_cur->nxt_free;
+#endif
             }
 
             /* If the insered free block is not the last one (ending at _end_heap),
@@ -181,14 +272,6 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
             /**********************************************************/
             *ptr_to_alloc = ptr;
 
-#ifdef CONFIG_STD_MALLOC_MUTEX
-            /* Unlocking of wmalloc usage */
-            if (!semaphore_release(&_ptr_semaphore)) {
-                malloc_errno = EHEAPSEMAPHORE;
-                return -1;
-            }
-#endif
-
             return 0;
             /**********************************************************/
             /**********************************************************/
@@ -211,19 +294,286 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
 
 end_error:
 
+    return -1;
+}
+/*********************************************************************************************/
+/*  Bulk functions: pending releases and checks (wmalloc usage must be locked)               */
+/*********************************************************************************************/
+int _wmalloc_bulk_begin(struct wheap *heap, const int release)
+{
+    (void) release;
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Bulk functions: allocation of n blocks of len bytes (wmalloc usage must be locked)       */
+/*********************************************************************************************/
+int _wmalloc_bulk_carve(struct wheap *heap, void **ptrs, const uint32_t n, const uint32_t len,
+                        const int flag)
+{
+    void *ptr           = NULL;
+
+    uint32_t len_bis    = len;
+    uint32_t sz         = 0;
+
+    /* Each block is sized as by wmalloc() */
+    if (len_bis < (uint32_t) DATA_MIN_SZ) {
+        len_bis = (uint32_t) DATA_MIN_SZ;
+    }
+
+    if (len_bis > (uint32_t) _heap_size) {
+        malloc_errno = EHEAPNOMEM;
+        return -1;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    len_bis = ALIGN(len_bis);
+#endif
+
+    sz = len_bis + HDR_SZ;
+
+    /* The n blocks are carved into one block, which must fit into the heap */
+    if (n > (uint32_t) _heap_size / sz) {
+        malloc_errno = EHEAPNOMEM;
+        return -1;
+    }
+
+    if (_alloc(heap, &ptr, (u__sz_t) (n * sz - HDR_SZ), flag) < 0) {
+        return -1;
+    }
+
+    _carve(heap, (struct block *) ((struct alloc_block *) ptr - 1), (u__sz_t) sz, n, ptrs);
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Bulk functions: extension of a run of blocks (wmalloc usage must be locked)              */
+/*********************************************************************************************/
+int _wmalloc_bulk_next(struct wheap *heap, void *first, void *last, void *ptr)
+{
+    struct block *b_cur = (struct block *) ((struct alloc_block *) first - 1);
+    struct block *b_lst = (struct block *) ((struct alloc_block *) last - 1);
+    struct block *b_nxt = (struct block *) ((struct alloc_block *) ptr - 1);
+
+    /* The first block is checked before the run is extended (the other blocks are
+     * checked by _free()) */
+    if ((b_lst == b_cur) && !_mergeable(heap, b_cur, b_cur)) {
+        return 0;
+    }
+
+    return ((b_nxt == NEXT(b_lst)) && _mergeable(heap, b_cur, b_nxt));
+}
+
+/*********************************************************************************************/
+/*  Bulk functions: release of a run of blocks (wmalloc usage must be locked)                */
+/*********************************************************************************************/
+int _wmalloc_bulk_free(struct wheap *heap, void **ptrs, const uint32_t n)
+{
+    /* The blocks of the run are merged into the first one, which is released */
+    if (n > 1) {
+        _merge(heap, (struct block *) ((struct alloc_block *) ptrs[0] - 1),
+               (struct block *) ((struct alloc_block *) ptrs[n - 1] - 1));
+    }
+
+    return _free(heap, ptrs);
+}
+
+/*********************************************************************************************/
+/*  Bulk functions: counting of the calls (wmalloc usage must be locked)                     */
+/*********************************************************************************************/
+void _wmalloc_bulk_stats(struct wheap *heap, const uint32_t nb_allocs, const uint32_t nb_frees,
+                         const uint32_t nb_failed)
+{
+    struct block *b_0 = (struct block *) _start_heap;
+
+    _stats.nb_allocs += nb_allocs;
+    _stats.nb_frees  += nb_frees;
+    _stats.nb_failed += nb_failed;
+
+    STATS_MAX_USED();
+}
+
+/*********************************************************************************************/
+/*  Aligned malloc() function                                                                */
+/*********************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_aligned(void **ptr_to_alloc, const uint16_t len, const uint32_t align, const int flag)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_aligned(void **ptr_to_alloc, const uint32_t len, const uint32_t align, const int flag)
+#endif
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+    struct block *b_0   = NULL;
+    void *ptrs[2]       = { NULL, NULL };
+    void *ptr           = NULL;
+
+    uint32_t len_bis    = (uint32_t) len;
+    uint32_t lead       = 0;
+    physaddr_t data     = 0;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    /* The default heap is set by the first allocation */
+    LAZY_INIT();
+
+    /* The alignment must be a power of two */
+    if (!align || (align & (align - 1))) {
+        malloc_errno = EHEAPALIGN;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Trying to lock of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+    /* The block is sized as by wmalloc() */
+    if (len_bis < (uint32_t) DATA_MIN_SZ) {
+        len_bis = (uint32_t) DATA_MIN_SZ;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    len_bis = ALIGN(len_bis);
+#endif
+
+    /* The allocated block holds the data at any alignment, after a leading space
+     * large enough for a free block header */
+    if ((align > (uint32_t) _heap_size) ||
+        (len_bis + align + HDR_FREE_SZ + HDR_SZ > (uint32_t) _heap_size)) {
+        malloc_errno = EHEAPNOMEM;
+        goto end_error;
+    }
+
+    if (_alloc(heap, &ptr, (u__sz_t) (len_bis + align - 1 + HDR_FREE_SZ), flag) < 0) {
+        goto end_error;
+    }
+
+    data = ((physaddr_t) ptr + align - 1) & ~((physaddr_t) align - 1);
+
+    if (data != (physaddr_t) ptr) {
+        /* The leading space is carved as a block and released into the free blocks (the
+         * aligned block header is written into the data, already blanked if sensitive) */
+        data = ((physaddr_t) ptr + HDR_FREE_SZ + align - 1) & ~((physaddr_t) align - 1);
+        lead = (uint32_t) (data - (physaddr_t) ptr);
+
+        _carve(heap, (struct block *) ((struct alloc_block *) ptr - 1), (u__sz_t) lead, 2, ptrs);
+
+        if (_free(heap, &ptrs[0]) < 0) {
+            goto end_error;
+        }
+
+        ptr = ptrs[1];
+    }
+
+    /* The space left after the data is released too (or merged into the next free block) */
+    if (_resize(heap, (struct block *) ((struct alloc_block *) ptr - 1), (u__sz_t) (len_bis + HDR_SZ)) < 0) {
+        goto end_error;
+    }
+
+    *ptr_to_alloc = ptr;
+
+    /* Successful allocation is counted and traced, with its alignment slack */
+    b_0 = (struct block *) _start_heap;
+    STATS_ALLOC();
+    STATS_ALIGNED(lead);
+    TRACE((flag == ALLOC_SENSITIVE ? WMALLOC_TRACE_ALLOC_SENSITIVE : WMALLOC_TRACE_ALLOC),
+          len, ptr);
+
+#if CANARIS_INTEGRITY == 1
+    /* b_0 first canari are updated for taking into account the modification of
+     * b_0->prv_sz = NB_FREE() and b_0->sz = SZ_FREE() */
+    UPDATE_CANARI_SZ(b_0);
+#endif
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+    /* Failed allocation is counted and traced */
+    STATS_FAILED();
+    TRACE_FAILED(WMALLOC_TRACE_ALLOC, len);
+
 #ifdef CONFIG_STD_MALLOC_MUTEX
     /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
      * of the initial error) */
-    semaphore_release(&_ptr_semaphore);
+    semaphore_release(&heap->semaphore);
 #endif
 
     return -1;
 }
 
+/*********************************************************************************************/
+/*  Carving of an allocated block into n blocks (wmalloc usage must be locked)               */
+/*********************************************************************************************/
+static void _carve(struct wheap *heap, struct block *b_cur, const u__sz_t sz, const uint32_t n, void **ptrs)
+{
+    struct block *b_nxt = NEXT(b_cur);
+    struct block *b     = b_cur;
+
+    /* The last block keeps the remaining space (alignment, or space too small for a
+     * free block left by the allocation) */
+    u__sz_t last_sz     = (u__sz_t) (SIZE(b_cur) - (n - 1) * sz);
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        if (i) {
+            /* The new headers are written into the data of the allocated block (already
+             * blanked if the block is sensitive) */
+            b           = (struct block *) ((physaddr_t) b_cur + i * sz);
+            b->flag     = b_cur->flag;
+            b->prv_sz   = sz;
+            b->prv_free = 0;
+            b->nxt_free = 0;
+        }
+
+        b->sz = (i == n - 1) ? last_sz : sz;
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(b);
+#endif
+
+        ptrs[i] = (void *) ((struct alloc_block *) b + 1);
+    }
+
+    /* The block following the carved ones is updated (prv_sz) */
+    if ((physaddr_t) b_nxt != _end_heap) {
+        b_nxt->prv_sz = last_sz;
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(b_nxt);
+#endif
+    }
+}
+
+
 /****************************************************************************************/
 
 /* Intermediate free block is updated (for malloc() function) */
-static int _update_inter_free(struct block *b_cur, struct block *b_nxt_int, u__sz_t cur_free_sz)
+static int _update_inter_free(struct wheap *heap, struct block *b_cur, struct block *b_nxt_int, u__sz_t cur_free_sz)
 {
     b_nxt_int->flag     = 0;
     b_nxt_int->prv_sz   = b_cur->sz;
@@ -241,7 +591,7 @@ static int _update_inter_free(struct block *b_cur, struct block *b_nxt_int, u__s
 /****************************************************************************************/
 
 /* Free block to be totally occupied is unlinked */
-static int _unlink(struct block *b_cur)
+static int _unlink(struct wheap *heap, struct block *b_cur)
 {
     BLOCK(b_cur->prv_free)->nxt_free = b_cur->nxt_free;
     BLOCK(b_cur->nxt_free)->prv_free = b_cur->prv_free;
@@ -260,34 +610,155 @@ static int _unlink(struct block *b_cur)
 
 
 /****************************************************************************************/
-/*  Free() function                                                                     */
+/*  Free() function (default heap)                                                      */
 /****************************************************************************************/
 int wfree(void **ptr_to_free)
 {
-    struct block *b_0   = (struct block *) _start_heap;
-    struct block *b_1   = b_0 + 1;
+#ifdef CONFIG_STD_MALLOC_CACHE
+    int ret = 0;
 
-    struct block *b_cur = NULL;
-    struct block *b_prv = NULL;
-    struct block *b_nxt = NULL;
+    /* Small blocks are kept by the cache of the calling context (no locking) */
+    if ((ret = _wmalloc_cache_put(ptr_to_free)) <= 0) {
+        return ret;
+    }
+#endif
 
-    uint8_t merged      = 0;
+    return wheap_free(_get_wmalloc_heap(), ptr_to_free);
+}
+
+/****************************************************************************************/
+/****************************************************************************************/
+/*  Checking of a block to be merged into a run (wmalloc usage must be locked)          */
+/****************************************************************************************/
+static int _mergeable(struct wheap *heap, struct block *b_cur, struct block *b)
+{
+    struct block *b_1 = (struct block *) _start_heap + 1;
+
+    if ((b < b_1) || ((physaddr_t) b + HDR_FREE_SZ > _end_heap)) {
+        return 0;
+    }
+
+    /* Only allocated blocks of the same kind are merged (a sensitive run is wiped) */
+    if (BAD_FLAG(b) || !IS_ALLOC(b) || (IS_SENSITIVE(b) != IS_SENSITIVE(b_cur))) {
+        return 0;
+    }
+
+    if ((SIZE(b) < HDR_FREE_SZ) || ((physaddr_t) b + SIZE(b) > _end_heap)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/****************************************************************************************/
+/*  Merging of a run of allocated blocks (wmalloc usage must be locked)                 */
+/****************************************************************************************/
+static void _merge(struct wheap *heap, struct block *b_cur, struct block *b_lst)
+{
+    struct block *b     = NEXT(b_cur);
+    struct block *b_nxt = NEXT(b_lst);
+    struct block *b_tmp = NULL;
+
+    /* The headers of the merged blocks are blanked, as they become data of b_cur */
+    while (b != b_nxt) {
+        b_tmp = NEXT(b);
+        _safe_flood_char((char *) b, CHAR_ZERO, HDR_SZ);
+        b = b_tmp;
+    }
+
+    b_cur->sz = (u__sz_t) ((physaddr_t) b_nxt - (physaddr_t) b_cur);
+#if CANARIS_INTEGRITY == 1
+    UPDATE_CANARI_SZ(b_cur);
+#endif
+
+    /* The block following the run is updated (prv_sz) */
+    if ((physaddr_t) b_nxt != _end_heap) {
+        b_nxt->prv_sz = SIZE(b_cur);
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(b_nxt);
+#endif
+    }
+}
+/****************************************************************************************/
+int wheap_free(wheap_t *heap, void **ptr_to_free)
+{
+    void *ptr = NULL;
 
     /* Errno is initialized to zero */
     malloc_errno = 0;
 
-#ifdef CONFIG_STD_MALLOC_MUTEX
-    _set_wmalloc_semaphore(&_ptr_semaphore);
+    if (!heap) {
+        malloc_errno = EHEAPPARAM;
+        return -1;
+    }
 
+#ifdef CONFIG_STD_MALLOC_MUTEX
     /* Locking of wmalloc usage */
-    if (!semaphore_trylock(&_ptr_semaphore)) {
+    if (!semaphore_trylock(&heap->semaphore)) {
+# ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+        /* The block is released later by the lock holder */
+        return _defer(heap, ptr_to_free);
+# else
         malloc_errno = EHEAPLOCKED;
         return -1;
+# endif
     }
 #endif
 
-    /* Getting of heap specification values */
-    _set_wmalloc_heap(&_start_heap, &_end_heap, &_heap_size);
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+    /* The block is released, then counted and traced */
+    ptr = *ptr_to_free;
+
+    if (_free(heap, ptr_to_free) < 0) {
+        goto end_error;
+    }
+
+    STATS_FREE();
+    TRACE(WMALLOC_TRACE_FREE, 0, ptr);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+#endif
+
+    return -1;
+}
+
+
+/****************************************************************************************/
+/*  Release of an allocated block (wmalloc usage must be locked, the caller counts it)  */
+/****************************************************************************************/
+static int _free(struct wheap *heap, void **ptr_to_free)
+{
+    struct block *b_0   = NULL;
+    struct block *b_1   = NULL;
+
+    struct block *b_cur = NULL;
+    struct block *b_prv = NULL;
+    struct block *b_nxt = NULL;
+
+    uint8_t merged      = 0;
+
+    b_0 = (struct block *) _start_heap;
+    b_1 = b_0 + 1;
 
     /* We check if the pointer is not null */
     if (!(*ptr_to_free)) {
@@ -376,6 +847,13 @@ int wfree(void **ptr_to_free)
             b_cur->nxt_free = b_nxt->nxt_free;
             NXT_FREE(b_cur)->prv_free = OFFSET(b_cur);
 
+#ifdef CONFIG_STD_MALLOC_NEXT_FIT
+            /* The roving cursor must not point into the merged block */
+            if (_roving == OFFSET(b_nxt)) {
+                _roving = OFFSET(b_cur);
+            }
+#endif
+
             /* RAZ of tne next block's header */
             _safe_flood_char((char *) b_nxt, CHAR_ZERO, HDR_FREE_SZ);
         }
@@ -399,7 +877,7 @@ int wfree(void **ptr_to_free)
     /* The eventual free blocks (previous and next) are update */
     if (!merged) {
 
-        if (_link(b_cur, b_0) < 0) {
+        if (_link(heap, b_cur, b_0) < 0) {
             malloc_errno = EHEAPNODEF;
             goto end_error;
         }
@@ -410,9 +888,350 @@ int wfree(void **ptr_to_free)
 
 end:
 
+    return 0;
+
+end_error:
+
+    return -1;
+}
+
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+/****************************************************************************************/
+/*  Deferred release: checks of a block without the lock (see malloc_defer.c)           */
+/****************************************************************************************/
+int _wmalloc_defer_check(struct wheap *heap, const void *ptr)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_1   = b_0 + 1;
+
+    /* The headers are checked when the block is really released */
+    if (((struct alloc_block *) ptr < (struct alloc_block *) b_1 + 1) ||
+        ((physaddr_t) ptr + PENDING_LINK_SZ > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        return -1;
+    }
+
+    if (IS_FREE((struct block *) ((struct alloc_block *) ptr - 1))) {
+        malloc_errno = EHEAPINTEGRITY;
+        return -1;
+    }
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Deferred release: release of a pending block (wmalloc usage must be locked)         */
+/****************************************************************************************/
+int _wmalloc_defer_free(struct wheap *heap, void *ptr)
+{
+    return _free(heap, &ptr);
+}
+
+/****************************************************************************************/
+/*  Deferred release: counting of the pending releases                                  */
+/****************************************************************************************/
+void _wmalloc_defer_stats(struct wheap *heap, const uint32_t nb_frees, const uint32_t nb_bad)
+{
+    _stats.nb_frees += nb_frees;
+
+    STATS_BAD_PENDING(nb_bad);
+}
+#endif
+
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+/****************************************************************************************/
+/*  Data length of a block which can be cached (0 if it must be released by the heap)  */
+/****************************************************************************************/
+uint32_t _wmalloc_cache_len(const void *ptr)
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_cur = NULL;
+
+    /* Only the checks which do not need wmalloc usage to be locked are done here (the
+     * block being owned by the caller, its flag and size cannot be modified meanwhile),
+     * the headers being checked when the block is really released */
+    if (!ptr || ((struct alloc_block *) ptr < (struct alloc_block *) (b_0 + 1) + 1) ||
+        ((physaddr_t) ptr > _end_heap)) {
+        return 0;
+    }
+
+    b_cur = (struct block *) ((struct alloc_block *) ptr - 1);
+
+    if (BAD_FLAG(b_cur) || !IS_ALLOC(b_cur) || !IS_NORMAL(b_cur)) {
+        return 0;
+    }
+
+    if ((SIZE(b_cur) <= HDR_SZ) || ((physaddr_t) b_cur + SIZE(b_cur) > _end_heap)) {
+        return 0;
+    }
+
+    return (uint32_t) (SIZE(b_cur) - HDR_SZ);
+}
+#endif
+
+
+/****************************************************************************************/
+/*  Realloc() function                                                                  */
+/****************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wrealloc(void **ptr_to_realloc, const uint16_t len)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wrealloc(void **ptr_to_realloc, const uint32_t len)
+#endif
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+
+    void *ptr_new       = NULL;
+
+    u__sz_t len_bis     = (u__sz_t) len;
+    u__sz_t sz          = 0;
+    u__sz_t old_len     = 0;
+
+    struct block *b_0   = NULL;
+    struct block *b_1   = NULL;
+    struct block *b_cur = NULL;
+
+    int flag            = ALLOC_NORMAL;
+    int ret             = 0;
+
+    /* A null pointer is simply allocated */
+    if (!(*ptr_to_realloc)) {
+        return wmalloc(ptr_to_realloc, len, ALLOC_NORMAL);
+    }
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+    b_0 = (struct block *) _start_heap;
+    b_1 = b_0 + 1;
+
+    /* We check if the pointer is not out of range */
+    if (((struct alloc_block *) (*ptr_to_realloc) < (struct alloc_block *) b_1 + 1) ||
+        ((physaddr_t) (*ptr_to_realloc) > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    b_cur = (struct block *) ((struct alloc_block *) (*ptr_to_realloc) - 1);
+
+    /* We check if the block has not already been freed */
+    if (IS_FREE(b_cur)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+    /* Allocated block cannot be smaller than a free bock header (think free()...) */
+    if (len_bis < (u__sz_t) DATA_MIN_SZ) {
+        len_bis = (u__sz_t) DATA_MIN_SZ;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    /* The asked length is aligned */
+    len_bis = ALIGN(len_bis);
+#endif
+
+    /* The block size must not overflow */
+    if ((uint32_t) len_bis + HDR_SZ > (uint32_t) _heap_size) {
+        malloc_errno = EHEAPNOMEM;
+        goto end_error;
+    }
+
+    /* Block size is calculated */
+    sz = (u__sz_t) (len_bis + HDR_SZ);
+
+    /* The block is first resized in place */
+    if ((ret = _resize(heap, b_cur, sz)) < 0) {
+        goto end_error;
+    }
+
+    if (!ret) {
+        /* The allocated memory may have grown (in place resizing is traced) */
+        STATS_MAX_USED();
+        TRACE(WMALLOC_TRACE_REALLOC, len, *ptr_to_realloc);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+        /* Unlocking of wmalloc usage */
+        if (!semaphore_release(&heap->semaphore)) {
+            malloc_errno = EHEAPSEMAPHORE;
+            return -1;
+        }
+#endif
+
+        return 0;
+    }
+
+    /* Else, the data are moved into a new block (the one of the pointer is kept
+     * until the copy is done, so that nothing is lost if no block fits) */
+    flag    = (IS_SENSITIVE(b_cur) ? ALLOC_SENSITIVE : ALLOC_NORMAL);
+    old_len = (u__sz_t) (SIZE(b_cur) - HDR_SZ);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (wmalloc() and wfree() lock it themselves) */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    if (wmalloc(&ptr_new, len, flag) < 0) {
+        return -1;
+    }
+
+    memcpy(ptr_new, *ptr_to_realloc, (old_len < len ? old_len : len));
+
+    if (wfree(ptr_to_realloc) < 0) {
+        return -1;
+    }
+
+    *ptr_to_realloc = ptr_new;
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+#endif
+
+    return -1;
+}
+
+
+/****************************************************************************************/
+/*  Usable size of an allocated block (its data length, which may exceed the asked one) */
+/****************************************************************************************/
+int wmalloc_usable_size(const void *ptr, uint32_t *len)
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+    struct block *b_0   = NULL;
+    struct block *b_cur = NULL;
+
+    if (!len) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    b_0 = (struct block *) _start_heap;
+
+    /* Only the header of the block is read, without locking (the block being owned by
+     * the caller, its flag and size cannot be modified meanwhile) */
+    if (!ptr || ((struct alloc_block *) ptr < (struct alloc_block *) (b_0 + 1) + 1) ||
+        ((physaddr_t) ptr > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        return -1;
+    }
+
+    b_cur = (struct block *) ((struct alloc_block *) ptr - 1);
+
+    if (BAD_FLAG(b_cur) || !IS_ALLOC(b_cur) ||
+        (SIZE(b_cur) <= HDR_SZ) || ((physaddr_t) b_cur + SIZE(b_cur) > _end_heap)) {
+        malloc_errno = EHEAPINTEGRITY;
+        return -1;
+    }
+
+    *len = (uint32_t) (SIZE(b_cur) - HDR_SZ);
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Trim function (in place shrink of an allocated block)                               */
+/****************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_trim(void *ptr, const uint16_t len)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_trim(void *ptr, const uint32_t len)
+#endif
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+
+    u__sz_t len_bis     = (u__sz_t) len;
+
+    struct block *b_0   = NULL;
+    struct block *b_1   = NULL;
+    struct block *b_cur = NULL;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+    b_0 = (struct block *) _start_heap;
+    b_1 = b_0 + 1;
+
+    /* We check if the pointer is not out of range */
+    if (((struct alloc_block *) ptr < (struct alloc_block *) b_1 + 1) ||
+        ((physaddr_t) ptr > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    b_cur = (struct block *) ((struct alloc_block *) ptr - 1);
+
+    /* We check if the block has not already been freed */
+    if (IS_FREE(b_cur)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+    /* Allocated block cannot be smaller than a free bock header (think free()...) */
+    if (len_bis < (u__sz_t) DATA_MIN_SZ) {
+        len_bis = (u__sz_t) DATA_MIN_SZ;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    /* The asked length is aligned */
+    len_bis = ALIGN(len_bis);
+#endif
+
+    /* A length not smaller than the current one leaves the block unchanged, else the
+     * tail is given back to the heap (unless it is too small for a free block) */
+    if ((uint32_t) len_bis + HDR_SZ < (uint32_t) SIZE(b_cur)) {
+
+        if (_resize(heap, b_cur, (u__sz_t) (len_bis + HDR_SZ)) < 0) {
+            goto end_error;
+        }
+
+        TRACE(WMALLOC_TRACE_REALLOC, len, ptr);
+    }
+
 #ifdef CONFIG_STD_MALLOC_MUTEX
     /* Unlocking of wmalloc usage */
-    if (!semaphore_release(&_ptr_semaphore)) {
+    if (!semaphore_release(&heap->semaphore)) {
         malloc_errno = EHEAPSEMAPHORE;
         return -1;
     }
@@ -425,16 +1244,136 @@ end_error:
 #ifdef CONFIG_STD_MALLOC_MUTEX
     /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
      * of the initial error) */
-    semaphore_release(&_ptr_semaphore);
+    semaphore_release(&heap->semaphore);
 #endif
 
     return -1;
 }
 
+
+/****************************************************************************************/
+
+/* Resizing of an allocated block in place, using the next block if it is free
+ * (returns 1 if the block cannot be resized in place) */
+static int _resize(struct wheap *heap, struct block *b_cur, u__sz_t sz)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_nxt = NULL;
+    struct block *b_rem = NULL;
+
+    u__sz_t cur_sz      = SIZE(b_cur);
+    u__sz_t max_sz      = cur_sz;
+
+    u_off_t prv_free    = 0;
+    u_off_t nxt_free    = 0;
+
+    /* The next block can be used if it is free */
+    if (NOT_LAST_BLOCK(b_cur)) {
+
+        b_nxt = NEXT(b_cur);
+
+        if (IS_FREE(b_nxt)) {
+            max_sz = (u__sz_t) (max_sz + SIZE(b_nxt));
+        } else {
+            b_nxt = NULL;
+        }
+    }
+
+    if (sz > max_sz) {
+        return 1;
+    }
+
+    /* If the remaining space is too small for a free block, it is kept in the block */
+    if (max_sz - sz < HDR_FREE_SZ) {
+        sz = max_sz;
+    }
+
+    /* Nothing to do if the block size does not change */
+    if (sz == cur_sz) {
+        return 0;
+    }
+
+    /* The next free block's links are kept, as its header may be overwritten
+     * (it is merged into the block or replaced by the remaining free block) */
+    if (b_nxt) {
+        prv_free = b_nxt->prv_free;
+        nxt_free = b_nxt->nxt_free;
+        DECREASE_SZ_FREE(SIZE(b_nxt));
+
+#ifdef CONFIG_STD_MALLOC_NEXT_FIT
+        /* The roving cursor must not point into the resized block */
+        if (_roving == OFFSET(b_nxt)) {
+            _roving = ((max_sz - sz) ? (u_off_t) (OFFSET(b_cur) + sz) : nxt_free);
+        }
+#endif
+    }
+
+    if (sz > cur_sz) {
+        /* RAZ of the memory added to the block's data (or at least of the
+         * former next block's header) */
+        if (IS_SENSITIVE(b_cur)) {
+            _safe_flood_char((char *) b_cur + cur_sz, CHAR_WRITTEN, (uint32_t) (sz - cur_sz));
+        } else {
+            _safe_flood_char((char *) b_nxt, CHAR_ZERO,
+                             (uint32_t) (sz - cur_sz < HDR_FREE_SZ ? sz - cur_sz : HDR_FREE_SZ));
+        }
+    } else if (IS_SENSITIVE(b_cur)) {
+        /* RAZ of the memory given back */
+        _safe_flood_char((char *) b_cur + sz, CHAR_ZERO, (uint32_t) (cur_sz - sz));
+    }
+
+    b_cur->sz = sz;
+
+    if (max_sz - sz) {
+
+        /* The remaining space is a new free block */
+        b_rem = NEXT(b_cur);
+
+        b_rem->flag   = 0;
+        b_rem->prv_sz = sz;
+        b_rem->sz     = (u__sz_t) (max_sz - sz);
+
+        INCREASE_SZ_FREE(SIZE(b_rem));
+
+        if (b_nxt) {
+            /* It replaces the next free block in the free blocks list */
+            b_rem->prv_free = prv_free;
+            b_rem->nxt_free = nxt_free;
+
+            PRV_FREE(b_rem)->nxt_free = OFFSET(b_rem);
+            NXT_FREE(b_rem)->prv_free = OFFSET(b_rem);
+        } else {
+            if (_link(heap, b_rem, b_0) < 0) {
+                malloc_errno = EHEAPNODEF;
+                return -1;
+            }
+
+            INCREASE_NB_FREE();
+        }
+
+        b_cur = b_rem;
+
+    } else if (b_nxt) {
+
+        /* The next free block is totally merged into the block */
+        BLOCK(prv_free)->nxt_free = nxt_free;
+        BLOCK(nxt_free)->prv_free = prv_free;
+
+        DECREASE_NB_FREE();
+    }
+
+    /* If the updated block is not the final one, the next block is updated (prv_sz) */
+    if (NOT_LAST_BLOCK(b_cur)) {
+        NEXT(b_cur)->prv_sz = b_cur->sz;
+    }
+
+    return 0;
+}
+
 /****************************************************************************************/
 
 
-static int _link(struct block *b_cur, struct block *b_0)
+static int _link(struct wheap *heap, struct block *b_cur, struct block *b_0)
 {
     struct block *b_prv = b_0;
     struct block *b_nxt = b_0;
@@ -458,40 +1397,107 @@ static int _link(struct block *b_cur, struct block *b_0)
     return 0;
 }
 
-
-/****************************************************************************************/
-/****************************************************************************************/
 /****************************************************************************************/
 
+#ifdef CONFIG_STD_MALLOC_BEST_FIT
+/* Smallest free block large enough for the given size (NULL if there is none) */
+static struct block *_best_fit(struct wheap *heap, struct block *b_0, u__sz_t sz)
+{
+    struct block *b_cur  = NXT_FREE(b_0);
+    struct block *b_best = NULL;
 
-#ifdef __GNUC__
-#ifdef __clang__
-# pragma clang optimize off
-#else
-# pragma GCC push_options
-# pragma GCC optimize("O0")
-#endif
+    u__sz_t nb_free      = NB_FREE();
+
+    while (nb_free && (b_cur != b_0)) {
+
+        STATS_SCAN();
+
+        if ((b_cur->sz >= sz) && ((!b_best) || (b_cur->sz < b_best->sz))) {
+            b_best = b_cur;
+
+            /* The remaining space could not be used anyway */
+            if (b_cur->sz - sz < HDR_FREE_SZ) {
+                break;
+            }
+        }
+
+        b_cur = NXT_FREE(b_cur);
+        --nb_free;
+    }
+
+    return b_best;
+}
 #endif
-static void *_safe_flood_char(void *dest, const char c, uint32_t n)
+
+
+/****************************************************************************************/
+/*  Statistics                                                                          */
+/****************************************************************************************/
+int wmalloc_stats(struct wmalloc_stats *stats)
 {
-    char *byte = (char*) dest;
+    struct wheap *heap  = _get_wmalloc_heap();
 
-    while (n) {
-        *byte = c;
-        ++byte;
-        --n;
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_cur = NULL;
+
+    u__sz_t nb_free     = 0;
+
+    if (!stats) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
     }
 
-    return dest;
-}
-#ifdef __GNUC__
-#ifdef __clang__
-# pragma clang optimize on
-#else
-# pragma GCC pop_options
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
 #endif
+
+    /* Counters are maintained by the allocator functions, the other values are
+     * read from b_0 */
+    stats->heap_sz          = (uint32_t) _heap_size;
+    stats->used_sz          = USED_SZ();
+    stats->free_sz          = (uint32_t) SZ_FREE();
+    stats->max_used_sz      = _stats.max_used_sz;
+    stats->largest_free_sz  = 0;
+    stats->nb_free_blocks   = (uint32_t) NB_FREE();
+    stats->nb_allocs        = _stats.nb_allocs;
+    stats->nb_frees         = _stats.nb_frees;
+    stats->nb_failed        = _stats.nb_failed;
+    stats->nb_aligned       = _stats.nb_aligned;
+    stats->align_slack_sz   = _stats.align_slack_sz;
+    stats->nb_scanned       = _stats.nb_scanned;
+    stats->nb_bad_pending   = _stats.nb_bad_pending;
+
+    nb_free = NB_FREE();
+
+    /* The largest free block is found by reading the free blocks list */
+    b_cur = NXT_FREE(b_0);
+
+    while (nb_free && (b_cur != b_0)) {
+
+        if (SIZE(b_cur) > stats->largest_free_sz) {
+            stats->largest_free_sz = (uint32_t) SIZE(b_cur);
+        }
+
+        b_cur = NXT_FREE(b_cur);
+        --nb_free;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
 #endif
 
+    return 0;
+}
+
+
 /****************************************************************************************/
 /****************************************************************************************/
 /****************************************************************************************/
@@ -499,6 +1505,8 @@ static void *_safe_flood_char(void *dest, const char c, uint32_t n)
 #ifdef PRINT_HEAP
 int print_heap(void)
 {
+    struct wheap *heap = _get_wmalloc_heap();
+
     struct block *b_0 = (struct block *) _start_heap;
     struct block *b_cur = NULL;
 
@@ -119,10 +119,6 @@ struct __attribute__((packed)) alloc_block {
                                     INCREASE_NB_FREE()
 
 
-void malloc_light_init(physaddr_t start_heap,
-                       physaddr_t end_heap,
-                       u__sz_t    heap_size);
-
 #endif
 #endif
 
@@ -0,0 +1,310 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC
+
+#include "malloc_priv.h"
+
+
+/* Pool structure :
+ * - the pool descriptor, the allocation bitmap and the objects are carved
+ *   into one single region given by wmalloc()
+ * - free objects are chained through their first word (simply linked list),
+ *   so that allocated objects do not carry any header
+ * - the bitmap holds one bit per object (1 for allocated) and permits to
+ *   detect double free in constant time
+ */
+struct wpool {
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    volatile uint32_t lock;
+#endif
+    void     *region;       /* Address given by wmalloc(), for wfree() */
+    int       flag;         /* ALLOC_NORMAL or ALLOC_SENSITIVE */
+    uint32_t  obj_size;     /* Objects size (rounded to a word) */
+    uint32_t  count;        /* Number of objects */
+    uint32_t  nb_free;      /* Number of free objects */
+    uint32_t *map;          /* Allocated objects bitmap */
+    uint8_t  *objs;         /* First object */
+    uint8_t  *end_objs;     /* End of the last object */
+    void     *first_free;   /* Head of the free objects list */
+};
+
+#define POOL_WORD           ((uint32_t) sizeof(uint32_t))
+#define POOL_ROUND(l)       (((l) + POOL_WORD - 1) & ~(POOL_WORD - 1))
+
+#define POOL_MAP_WORDS(n)   (((n) + 31) >> 5)
+
+#define POOL_IS_ALLOC(p,i)  ((p)->map[(i) >> 5] & ((uint32_t) 1 << ((i) & 31)))
+#define POOL_SET_ALLOC(p,i) (p)->map[(i) >> 5] |= ((uint32_t) 1 << ((i) & 31))
+#define POOL_SET_FREE(p,i)  (p)->map[(i) >> 5] &= ~((uint32_t) 1 << ((i) & 31))
+
+#define POOL_NEXT(o)        (*(void **) (o))
+
+
+
+/*********************************************************************************************/
+/*  Pool creation                                                                            */
+/*********************************************************************************************/
+int wpool_create(wpool_t **pool, const uint32_t obj_size, const uint32_t count, const int flag)
+{
+    struct wpool *p = NULL;
+    void     *region = NULL;
+    uint32_t  sz_obj;
+    uint32_t  sz_map;
+    uint32_t  len;
+    uint32_t  i;
+
+    /* Checking of the parameters */
+    if (!pool || !obj_size || !count) {
+        malloc_errno = EPOOLPARAM;
+        return -1;
+    }
+
+    if ((flag != ALLOC_NORMAL) && (flag != ALLOC_SENSITIVE)) {
+        malloc_errno = EHEAPFLAGNOTVALID;
+        return -1;
+    }
+
+    /* A free object must be able to hold the free list pointer */
+    sz_obj = (obj_size < sizeof(void *)) ? (uint32_t) sizeof(void *) : obj_size;
+    sz_obj = POOL_ROUND(sz_obj);
+    sz_map = POOL_MAP_WORDS(count) * POOL_WORD;
+
+    /* Whole region size (including alignment slack), checked against overflow */
+    if (sz_obj > (((uint32_t) 1 << (CONFIG_STD_MALLOC_SIZE_LEN - 1)) / count)) {
+        malloc_errno = EPOOLPARAM;
+        return -1;
+    }
+
+    len = POOL_ROUND(sizeof(struct wpool)) + sz_map + (sz_obj * count) + POOL_WORD - 1;
+
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+    if (len > 0xFFFF) {
+        malloc_errno = EPOOLPARAM;
+        return -1;
+    }
+
+    if (wmalloc(&region, (uint16_t) len, flag) < 0) {
+        return -1;
+    }
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+    if (wmalloc(&region, len, flag) < 0) {
+        return -1;
+    }
+#endif
+
+    /* The descriptor and the objects are word aligned, whatever the headers size */
+    p = (struct wpool *) POOL_ROUND((physaddr_t) region);
+
+    p->region   = region;
+    p->flag     = flag;
+    p->obj_size = sz_obj;
+    p->count    = count;
+    p->nb_free  = count;
+    p->map      = (uint32_t *) ((physaddr_t) p + POOL_ROUND(sizeof(struct wpool)));
+    p->objs     = (uint8_t *) p->map + sz_map;
+    p->end_objs = p->objs + (sz_obj * count);
+
+    for (i = 0; i < POOL_MAP_WORDS(count); i++) {
+        p->map[i] = 0;
+    }
+
+    /* Chaining of the free objects, in increasing order of addresses */
+    for (i = 0; i < count - 1; i++) {
+        POOL_NEXT(p->objs + (i * sz_obj)) = p->objs + ((i + 1) * sz_obj);
+    }
+
+    POOL_NEXT(p->objs + (i * sz_obj)) = NULL;
+    p->first_free = p->objs;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_init(&p->lock);
+#endif
+
+    *pool = p;
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Pool destruction                                                                         */
+/*********************************************************************************************/
+int wpool_destroy(wpool_t **pool)
+{
+    void *region;
+
+    if (!pool || !(*pool)) {
+        malloc_errno = EPOOLPARAM;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    if (!mutex_trylock(&(*pool)->lock)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    /* For sensitive pools, the whole region is wiped by wfree() */
+    region = (*pool)->region;
+
+    if (wfree(&region) < 0) {
+#ifdef CONFIG_STD_MALLOC_MUTEX
+        mutex_unlock(&(*pool)->lock);
+#endif
+        return -1;
+    }
+
+    *pool = NULL;
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Object allocation                                                                        */
+/*********************************************************************************************/
+int wpool_alloc(wpool_t *pool, void **ptr_to_alloc)
+{
+    void     *obj;
+    uint32_t  i;
+
+    if (!pool || !ptr_to_alloc) {
+        malloc_errno = EPOOLPARAM;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    if (!mutex_trylock(&pool->lock)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    obj = pool->first_free;
+
+    if (!obj) {
+        malloc_errno = EPOOLEMPTY;
+        goto end_error;
+    }
+
+    /* The free list could have been corrupted (overflow of a neighbour object) */
+    if (((uint8_t *) obj < pool->objs) || ((uint8_t *) obj >= pool->end_objs)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+    i = (uint32_t) ((uint8_t *) obj - pool->objs) / pool->obj_size;
+
+    if (POOL_IS_ALLOC(pool, i)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+    pool->first_free = POOL_NEXT(obj);
+    pool->nb_free--;
+    POOL_SET_ALLOC(pool, i);
+
+    /* RAZ of the whole object (ALLOC_SENSITIVE semantics of wmalloc()) */
+    if (pool->flag == ALLOC_SENSITIVE) {
+        _safe_flood_char((char *) obj, CHAR_WRITTEN, pool->obj_size);
+    }
+
+    *ptr_to_alloc = obj;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_unlock(&pool->lock);
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_unlock(&pool->lock);
+#endif
+
+    return -1;
+}
+
+/*********************************************************************************************/
+/*  Object release                                                                           */
+/*********************************************************************************************/
+int wpool_free(wpool_t *pool, void **ptr_to_free)
+{
+    uint8_t  *obj;
+    uint32_t  off;
+    uint32_t  i;
+
+    if (!pool || !ptr_to_free) {
+        malloc_errno = EPOOLPARAM;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    if (!mutex_trylock(&pool->lock)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    obj = (uint8_t *) (*ptr_to_free);
+
+    /* We check if the pointer is not null */
+    if (!obj) {
+        malloc_errno = EHEAPALREADYFREE;
+        goto end_error;
+    }
+
+    /* We check if the pointer is an object of the pool */
+    if ((obj < pool->objs) || (obj >= pool->end_objs)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    off = (uint32_t) (obj - pool->objs);
+    i = off / pool->obj_size;
+
+    if (off != i * pool->obj_size) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    /* We check if the object has not already been freed */
+    if (!POOL_IS_ALLOC(pool, i)) {
+        malloc_errno = EHEAPALREADYFREE;
+        goto end_error;
+    }
+
+    /* RAZ of the whole object to free */
+    if (pool->flag == ALLOC_SENSITIVE) {
+        _safe_flood_char((char *) obj, CHAR_ZERO, pool->obj_size);
+    }
+
+    POOL_SET_FREE(pool, i);
+    POOL_NEXT(obj) = pool->first_free;
+    pool->first_free = obj;
+    pool->nb_free++;
+
+    /* Pointer to allocated object is set to 0 */
+    *ptr_to_free = NULL;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_unlock(&pool->lock);
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    mutex_unlock(&pool->lock);
+#endif
+
+    return -1;
+}
+
+#endif
@@ -3,8 +3,8 @@
  * (implementation of an allocator for the WooKey project)
  */
 
-#ifndef H_MALLOC_INIT
-#define H_MALLOC_INIT
+#ifndef H_MALLOC_PRIV
+#define H_MALLOC_PRIV
 
 #include "autoconf.h"       /* For configuration options (real case) */
 
@@ -17,6 +17,15 @@
 #include "libc/stdio.h"
 #include "libc/nostd.h"
 #include "libc/semaphore.h"
+#include "libc/string.h"
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+# ifdef CONFIG_ARCH_ARMV7M
+#  include "arch/cores/armv7-m/m4-sync.h"
+# else
+#  error "Unknown architecture"
+# endif
+#endif
 
 
 /********************************************************************************/
@@ -42,9 +51,39 @@ typedef uint32_t u_can_t;
 typedef uint32_t u__sz_t;
 typedef uint32_t u_off_t;
 typedef uint64_t u_can_t;
+# else
+#  error "Sizes length must be 16 or 32 bits"
 # endif
 
 
+/* Heap descriptor (default heap of the wmalloc() functions, or heap handle given
+ * by wheap_init() and stored at the start of its region) */
+
+struct wheap {
+    physaddr_t  start_heap;
+    physaddr_t  end_heap;
+    u__sz_t     heap_size;
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+    u_can_t     can_sz;                 /* Canaries (random or not) */
+    u_can_t     can_free;
+    u_off_t     check_cursor;           /* Offset of the next header to check (0 for b_0) */
+#endif
+#ifdef CONFIG_STD_MALLOC_NEXT_FIT
+    u_off_t     roving;                 /* Offset of the free block where the next search starts */
+#endif
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    volatile uint32_t semaphore;        /* Lock of this heap only */
+#endif
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    volatile uint32_t pending;          /* Blocks freed while the heap was locked */
+#endif
+    struct wmalloc_stats stats;         /* Counters of the allocator functions */
+};
+
+/* Room taken by a heap handle descriptor at the start of its region */
+#define WHEAP_DESC_SZ       ((uint32_t) ((sizeof(struct wheap) + 7) & ~7))
+
+
 
 /* Functions prototypes */
 
@@ -56,7 +95,13 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag);
 
 int wfree(void **ptr_to_free);
 
-#if CONFIG_STD_MALLOC_INTEGRITY >= 2 
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wrealloc(void **ptr_to_realloc, const uint16_t len);
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wrealloc(void **ptr_to_realloc, const uint32_t len);
+#endif
+
+#if (CONFIG_STD_MALLOC_INTEGRITY >= 2) && !defined(CONFIG_STD_MALLOC_STD)
 int _heap_integrity(void);
 #endif
 
@@ -67,6 +112,11 @@ int _heap_integrity(void);
 //#define _ALLOC_SENSITIVE     (int) 0xFFFFFFFF
 
 
+/* Secure flooding (never removed by the compiler, see malloc_flood.c) */
+
+void *_safe_flood_char(void *dest, const char c, uint32_t n);
+
+
 /* Characters used for blanking freed and allocated blocks */
 
 # define CHAR_ZERO              0
@@ -124,6 +174,154 @@ int _heap_integrity(void);
 #define INTEGRITY_FREE_NEQ_NXT  -13
 
 
+/* Statistics (each allocator holds the counters in a static struct wmalloc_stats
+ * _stats, only updated while wmalloc usage is locked) */
+
+#define USED_SZ()           (uint32_t) (_heap_size - HDR_FREE_SZ - SZ_FREE())
+
+#define STATS_MAX_USED()    if (USED_SZ() > _stats.max_used_sz) { \
+                                _stats.max_used_sz = USED_SZ(); \
+                            }
+#define STATS_ALLOC()       ++_stats.nb_allocs; \
+                            STATS_MAX_USED()
+#define STATS_FREE()        ++_stats.nb_frees
+#define STATS_FAILED()      ++_stats.nb_failed
+#define STATS_ALIGNED(l)    ++_stats.nb_aligned; \
+                            _stats.align_slack_sz += (uint32_t) (l)
+#define STATS_SCAN()        ++_stats.nb_scanned
+#define STATS_BAD_PENDING(n) _stats.nb_bad_pending += (uint32_t) (n)
+
+
+/* Incremental checking (see malloc_check.c: the offset of the next header to check is
+ * kept in the heap descriptor, each secure allocator giving the check of one header and
+ * naming the cursor _check_cursor, which must be moved when this header vanishes) */
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+int _check_step(struct wheap *heap, uint32_t budget);
+int _check_block(struct wheap *heap, const u_off_t off, u_off_t *nxt);
+
+# define CHECK_CURSOR_MOVE(b,b_new)  if (_check_cursor == OFFSET(b)) { \
+                                         _check_cursor = OFFSET(b_new); \
+                                     }
+#else
+# define CHECK_CURSOR_MOVE(b,b_new)
+#endif
+
+
+/* Deferred release (blocks given to wfree() while wmalloc usage is locked are pushed
+ * on a lock-free list, linked by the first word of their data, and released by the
+ * next lock holder). The second word holds a mark (the block address xored with a
+ * magic value) while the block is pending, so that a second push is refused */
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+struct __attribute__((packed)) pending_link {
+    uint32_t nxt;
+    uint32_t mark;
+};
+
+# define PENDING_MAGIC      0xA5C3E10F
+
+# define PENDING_LINK_SZ    ((physaddr_t) sizeof(struct pending_link))
+# define PENDING_NXT(p)     ((void *) (physaddr_t) ((struct pending_link *) (p))->nxt)
+# define PENDING_MARK(p)    ((uint32_t) (physaddr_t) (p) ^ PENDING_MAGIC)
+
+# define IS_PENDING(p)      (((struct pending_link *) (p))->mark == PENDING_MARK(p))
+# define MAKE_PENDING(p)    ((struct pending_link *) (p))->mark = PENDING_MARK(p)
+# define CLEAR_PENDING(p)   ((struct pending_link *) (p))->mark = 0
+
+/* See malloc_defer.c, the allocator giving the checks of a block which do not need the
+ * lock, the release of a pending block and the counting of the releases */
+int _defer(struct wheap *heap, void **ptr_to_free);
+uint32_t _drain(struct wheap *heap);
+
+int _wmalloc_defer_check(struct wheap *heap, const void *ptr);
+int _wmalloc_defer_free(struct wheap *heap, void *ptr);
+void _wmalloc_defer_stats(struct wheap *heap, const uint32_t nb_frees, const uint32_t nb_bad);
+
+/* Smallest data length of a block (room for the free block header, and for the
+ * pending link) */
+# define DATA_MIN_SZ        (((HDR_FREE_SZ - HDR_SZ) > PENDING_LINK_SZ) ? \
+                             (HDR_FREE_SZ - HDR_SZ) : PENDING_LINK_SZ)
+#else
+# define DATA_MIN_SZ        (HDR_FREE_SZ - HDR_SZ)
+#endif
+
+
+/* Lazy initialization (the default heap is set by the first wmalloc(), wmalloc_aligned()
+ * or wmalloc_bulk() call, see malloc_init.c) */
+
+#ifdef CONFIG_STD_MALLOC_LAZY_INIT
+int _wmalloc_lazy_init(void);
+# define LAZY_INIT()        if (_wmalloc_lazy_init() < 0) { \
+                                return -1; \
+                            }
+#else
+# define LAZY_INIT()
+#endif
+
+
+/* Small blocks caches (see malloc_cache.c, the allocator giving the data length of
+ * a block which can be cached, or 0) */
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+int _wmalloc_cache_get(void **ptr_to_alloc, const uint32_t len, const int flag);
+int _wmalloc_cache_put(void **ptr_to_free);
+uint32_t _wmalloc_cache_len(const void *ptr);
+#endif
+
+
+/* Bulk allocation and release (see malloc_bulk.c, the allocator giving the pending
+ * releases and checks, the carving of n blocks, the extension and the release of a run
+ * of adjacent blocks, and the counting of the calls) */
+
+int _wmalloc_bulk_begin(struct wheap *heap, const int release);
+int _wmalloc_bulk_carve(struct wheap *heap, void **ptrs, const uint32_t n, const uint32_t len,
+                        const int flag);
+int _wmalloc_bulk_next(struct wheap *heap, void *first, void *last, void *ptr);
+int _wmalloc_bulk_free(struct wheap *heap, void **ptrs, const uint32_t n);
+void _wmalloc_bulk_stats(struct wheap *heap, const uint32_t nb_allocs, const uint32_t nb_frees,
+                         const uint32_t nb_failed);
+
+
+/* Reallocation, trim and usable size of the bins and TLSF allocators (see
+ * malloc_realloc.c, the allocator giving the checks of the header of an allocated
+ * block, and its in place resizing, which returns 1 if the next block cannot give the
+ * room) */
+
+#if defined(CONFIG_STD_MALLOC_BINS) || defined(CONFIG_STD_MALLOC_TLSF)
+# if CONFIG_STD_MALLOC_INTEGRITY != 0
+int _wmalloc_check_hdr(struct wheap *heap, const void *ptr, const u__sz_t flag);
+# endif
+int _wmalloc_resize(struct wheap *heap, void *ptr, const u__sz_t sz);
+#endif
+
+
+/* Trace (calls recorded while wmalloc usage is locked, see malloc_trace.c) */
+
+#ifdef CONFIG_STD_MALLOC_TRACE
+void _wmalloc_trace(const uint8_t op, const uint32_t len, const uint32_t off);
+
+/* Only the calls on the default heap are recorded (the trace is protected by its lock) */
+# if defined(CONFIG_STD_MALLOC_LIGHT) || defined(CONFIG_STD_MALLOC_STD)
+#  define TRACE_HEAP()      (heap == _get_wmalloc_heap())
+# else
+#  define TRACE_HEAP()      1
+# endif
+
+# define TRACE(op,l,p)      if (TRACE_HEAP()) { \
+                                _wmalloc_trace((op), (uint32_t) (l), \
+                                               (uint32_t) ((physaddr_t) (p) - _start_heap)); \
+                            }
+# define TRACE_FAILED(op,l) if (TRACE_HEAP()) { \
+                                _wmalloc_trace((uint8_t) ((op) | WMALLOC_TRACE_FAILED), \
+                                               (uint32_t) (l), 0); \
+                            }
+#else
+# define TRACE(op,l,p)      (void) (p)
+# define TRACE_FAILED(op,l)
+#endif
+
+
 /* Alignment */
 
 #if CONFIG_STD_MALLOC_ALIGN > 1
@@ -151,6 +349,14 @@ int _heap_integrity(void);
 #include "malloc_bins.h"
 #endif
 
+#ifdef CONFIG_STD_MALLOC_TLSF
+#include "malloc_tlsf.h"
+#endif
+
+#ifdef CONFIG_STD_MALLOC_BITMAP
+#include "malloc_bitmap.h"
+#endif
+
 
 #endif
 #endif
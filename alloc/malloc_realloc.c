@@ -0,0 +1,353 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#if defined(CONFIG_STD_MALLOC_BINS) || defined(CONFIG_STD_MALLOC_TLSF)
+
+#include "malloc_priv.h"
+
+
+/* Reallocation structure (allocators with the same headers and segregated free lists) :
+ * - the block is first resized in place by the allocator (_wmalloc_resize()), using
+ *   the next block if it is free, the remaining space being given back as a free block
+ * - else its data are moved into a new block given by wmalloc(), the block being kept
+ *   until the copy is done, then released by wfree()
+ * - the allocator gives the checks of the header of an allocated block
+ *   (_wmalloc_check_hdr())
+ * - wmalloc_trim() uses the same in place resizing for shrinking only, and
+ *   wmalloc_usable_size() reads the header of the block without locking
+ */
+
+/* Heap specifications (the default heap descriptor, whose fields are the ones of the
+ * allocator) */
+#define _start_heap         (heap->start_heap)
+#define _end_heap           (heap->end_heap)
+#define _heap_size          (heap->heap_size)
+
+
+/*********************************************************************************************/
+/*  Realloc() function                                                                       */
+/*********************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wrealloc(void **ptr_to_realloc, const uint16_t len)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wrealloc(void **ptr_to_realloc, const uint32_t len)
+#endif
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+
+    void *ptr_new       = NULL;
+
+    u__sz_t len_bis     = (u__sz_t) len;
+    u__sz_t sz          = 0;
+    u__sz_t old_len     = 0;
+
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_1   = b_0 + 1;
+    struct block *b_cur = NULL;
+
+    int flag            = ALLOC_NORMAL;
+    int ret             = 0;
+
+    /* A null pointer is simply allocated */
+    if (!(*ptr_to_realloc)) {
+        return wmalloc(ptr_to_realloc, len, ALLOC_NORMAL);
+    }
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+#if CONFIG_STD_MALLOC_CHECK_STEP > 0
+    /* Incremental checking of the heap's headers */
+    if (_check_step(heap, CONFIG_STD_MALLOC_CHECK_STEP) < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* We check if the pointer is not out of range */
+    if (((struct alloc_block *) (*ptr_to_realloc) < (struct alloc_block *) b_1 + 1) ||
+        ((physaddr_t) (*ptr_to_realloc) > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    b_cur = (struct block *) ((struct alloc_block *) (*ptr_to_realloc) - 1);
+
+    /* We check if the block has not already been freed */
+    if (IS_FREE(b_cur)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 2
+    /* Checking of the heap's integrity */
+    if (_heap_integrity() < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#elif CONFIG_STD_MALLOC_INTEGRITY == 1
+    /* We check the integrity of the header (if no heap integrity checking) */
+    if (_wmalloc_check_hdr(heap, *ptr_to_realloc, CHECK_ALL_ALLOC)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* Allocated block cannot be smaller than a free bock header (think free()...) */
+    if (len_bis < (u__sz_t) DATA_MIN_SZ) {
+        len_bis = (u__sz_t) DATA_MIN_SZ;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    /* The asked length is aligned */
+    len_bis = ALIGN(len_bis);
+#endif
+
+    /* The block size must not overflow */
+    if ((uint32_t) len_bis + HDR_SZ > (uint32_t) _heap_size) {
+        malloc_errno = EHEAPNOMEM;
+        goto end_error;
+    }
+
+    /* Block size is calculated */
+    sz = (u__sz_t) (len_bis + HDR_SZ);
+
+    /* The block is first resized in place */
+    if ((ret = _wmalloc_resize(heap, *ptr_to_realloc, sz)) < 0) {
+        goto end_error;
+    }
+
+    if (!ret) {
+        /* In place resizing is traced */
+        TRACE(WMALLOC_TRACE_REALLOC, len, *ptr_to_realloc);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+        /* Unlocking of wmalloc usage */
+        if (!semaphore_release(&heap->semaphore)) {
+            malloc_errno = EHEAPSEMAPHORE;
+            return -1;
+        }
+#endif
+
+        return 0;
+    }
+
+    /* Else, the data are moved into a new block (the one of the pointer is kept
+     * until the copy is done, so that nothing is lost if no block fits) */
+    flag    = (IS_SENSITIVE(b_cur) ? ALLOC_SENSITIVE : ALLOC_NORMAL);
+    old_len = (u__sz_t) (SIZE(b_cur) - HDR_SZ);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (wmalloc() and wfree() lock it themselves) */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    if (wmalloc(&ptr_new, len, flag) < 0) {
+        return -1;
+    }
+
+    memcpy(ptr_new, *ptr_to_realloc, (old_len < len ? old_len : len));
+
+    if (wfree(ptr_to_realloc) < 0) {
+        return -1;
+    }
+
+    *ptr_to_realloc = ptr_new;
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+#endif
+
+    return -1;
+}
+
+/*********************************************************************************************/
+/*  Usable size of an allocated block (its data length, which may exceed the asked one)      */
+/*********************************************************************************************/
+int wmalloc_usable_size(const void *ptr, uint32_t *len)
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+
+    struct block *b_0   = NULL;
+    struct block *b_cur = NULL;
+
+    if (!len) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    b_0 = (struct block *) _start_heap;
+
+    /* Only the header of the block is read, without locking (the block being owned by
+     * the caller, its flag and size cannot be modified meanwhile) */
+    if (!ptr || ((struct alloc_block *) ptr < (struct alloc_block *) (b_0 + 1) + 1) ||
+        ((physaddr_t) ptr > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        return -1;
+    }
+
+    b_cur = (struct block *) ((struct alloc_block *) ptr - 1);
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+    /* We check the integrity of the header */
+    if (_wmalloc_check_hdr(heap, ptr, CHECK_CANARI | CHECK_SZ_CUR)) {
+        malloc_errno = EHEAPINTEGRITY;
+        return -1;
+    }
+#endif
+
+    if (BAD_FLAG(b_cur) || !IS_ALLOC(b_cur) ||
+        (SIZE(b_cur) <= HDR_SZ) || ((physaddr_t) b_cur + SIZE(b_cur) > _end_heap)) {
+        malloc_errno = EHEAPINTEGRITY;
+        return -1;
+    }
+
+    *len = (uint32_t) (SIZE(b_cur) - HDR_SZ);
+
+    return 0;
+}
+
+/*********************************************************************************************/
+/*  Trim function (in place shrink of an allocated block)                                    */
+/*********************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_trim(void *ptr, const uint16_t len)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_trim(void *ptr, const uint32_t len)
+#endif
+{
+    struct wheap *heap  = _get_wmalloc_heap();
+
+    u__sz_t len_bis     = (u__sz_t) len;
+
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_1   = b_0 + 1;
+    struct block *b_cur = NULL;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock(&heap->semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+#if CONFIG_STD_MALLOC_CHECK_STEP > 0
+    /* Incremental checking of the heap's headers */
+    if (_check_step(heap, CONFIG_STD_MALLOC_CHECK_STEP) < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* We check if the pointer is not out of range */
+    if (((struct alloc_block *) ptr < (struct alloc_block *) b_1 + 1) ||
+        ((physaddr_t) ptr > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    b_cur = (struct block *) ((struct alloc_block *) ptr - 1);
+
+    /* We check if the block has not already been freed */
+    if (IS_FREE(b_cur)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 2
+    /* Checking of the heap's integrity */
+    if (_heap_integrity() < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#elif CONFIG_STD_MALLOC_INTEGRITY == 1
+    /* We check the integrity of the header (if no heap integrity checking) */
+    if (_wmalloc_check_hdr(heap, ptr, CHECK_ALL_ALLOC)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* Allocated block cannot be smaller than a free bock header (think free()...) */
+    if (len_bis < (u__sz_t) DATA_MIN_SZ) {
+        len_bis = (u__sz_t) DATA_MIN_SZ;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    /* The asked length is aligned */
+    len_bis = ALIGN(len_bis);
+#endif
+
+    /* A length not smaller than the current one leaves the block unchanged, else the
+     * tail is given back to the heap (unless it is too small for a free block) */
+    if ((uint32_t) len_bis + HDR_SZ < (uint32_t) SIZE(b_cur)) {
+
+        if (_wmalloc_resize(heap, ptr, (u__sz_t) (len_bis + HDR_SZ)) < 0) {
+            goto end_error;
+        }
+
+        TRACE(WMALLOC_TRACE_REALLOC, len, ptr);
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release(&heap->semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release(&heap->semaphore);
+#endif
+
+    return -1;
+}
+
+#endif
@@ -0,0 +1,1663 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC_TLSF
+
+#include "malloc_priv.h"
+
+
+/* Global variables */
+
+/* Heap specifications */
+static physaddr_t _start_heap;
+static physaddr_t _end_heap;
+static u__sz_t    _heap_size;
+
+#if CANARIS_INTEGRITY == 1
+/* Canaries (random or not) */
+static u_can_t _can_sz;
+static u_can_t _can_free;
+#endif
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+/* Semaphore (address of the wmalloc semaphore, set by _set_wmalloc_semaphore()) */
+static volatile uint32_t _ptr_semaphore;
+#endif
+
+/* Statistics (counters of the allocator functions, see wmalloc_stats()) */
+static struct wmalloc_stats _stats;
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+/* Incremental checking: offset of the next header to check (0 for b_0), kept in
+ * the default heap descriptor (see malloc_check.c) */
+# define _check_cursor      (_get_wmalloc_heap()->check_cursor)
+#endif
+
+/* TLSF lists: offset of the first free block of each list (0 if the list is
+ * empty), and bitmaps of the non-empty lists. These are kept out of the heap
+ * so that an overflow of an allocated block cannot corrupt them */
+static u_off_t  _lists[FL_COUNT][SL_COUNT];
+static uint32_t _fl_map;
+static uint32_t _sl_map[FL_COUNT];
+
+
+/* Static functions prototypes */
+static int _alloc(void **ptr_to_alloc, const u__sz_t len, const int flag);
+static void _carve(struct block *b_cur, const u__sz_t sz, const uint32_t n, void **ptrs);
+static int _mergeable(struct block *b_cur, struct block *b);
+static void _merge(struct block *b_cur, struct block *b_lst);
+static int _free(void **ptr_to_free);
+static inline void _tlsf_mapping(uint32_t sz, uint8_t *fl, uint8_t *sl);
+static struct block *_tlsf_find(u__sz_t sz);
+static void _tlsf_insert(struct block *b_cur);
+static void _tlsf_remove(struct block *b_cur);
+static int _resize(struct block *b_cur, u__sz_t sz);
+
+#if CONFIG_STD_MALLOC_INTEGRITY != 0
+static int check_hdr(struct block *b, u__sz_t flag);
+#endif
+
+
+/****************************************************************************************/
+/*  Initialization of the TLSF lists                                                    */
+/****************************************************************************************/
+void malloc_tlsf_init(void)
+{
+    struct block *b_0 = NULL;
+    struct block *b_1 = NULL;
+    uint8_t i, j;
+
+    /* Getting of heap specification values */
+    _set_wmalloc_heap(&_start_heap, &_end_heap, &_heap_size);
+#if CANARIS_INTEGRITY == 1
+    _set_wmalloc_canaries(&_can_sz, &_can_free);
+#endif
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    _set_wmalloc_semaphore(&_ptr_semaphore);
+#endif
+
+    for (i = 0; i < FL_COUNT; ++i) {
+        for (j = 0; j < SL_COUNT; ++j) {
+            _lists[i][j] = 0;
+        }
+        _sl_map[i] = 0;
+    }
+    _fl_map = 0;
+
+    b_0 = (struct block *) _start_heap;
+    b_1 = b_0 + 1;
+
+    /* b_0 only keeps the number of free blocks and the free memory,
+     * the free lists are held by the TLSF lists */
+    b_0->prv_free = 0;
+    b_0->nxt_free = 0;
+#if CANARIS_INTEGRITY == 1
+    UPDATE_CANARI_BOTH(b_0);
+#endif
+
+    _tlsf_insert(b_1);
+}
+
+
+/*********************************************************************************************/
+/*  Malloc() function                                                                        */
+/*********************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc(void **ptr_to_alloc, const uint16_t len, const int flag)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag)
+#endif
+{
+    struct block *b_0   = NULL;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    /* The default heap is set by the first allocation */
+    LAZY_INIT();
+
+    b_0 = (struct block *) _start_heap;
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+    /* Small blocks are first taken from the cache of the calling context (no locking) */
+    if (!_wmalloc_cache_get(ptr_to_alloc, (uint32_t) len, flag)) {
+        return 0;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Trying to lock of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(_get_wmalloc_heap());
+#endif
+
+    /* The block is allocated */
+    if (_alloc(ptr_to_alloc, (u__sz_t) len, flag) < 0) {
+        goto end_error;
+    }
+
+    /* Successful allocation is counted and traced */
+    STATS_ALLOC();
+    TRACE((flag == ALLOC_SENSITIVE ? WMALLOC_TRACE_ALLOC_SENSITIVE : WMALLOC_TRACE_ALLOC),
+          len, *ptr_to_alloc);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+    /* Failed allocation is counted and traced */
+    STATS_FAILED();
+    TRACE_FAILED(WMALLOC_TRACE_ALLOC, len);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+
+/****************************************************************************************/
+/*  Allocation of a block (wmalloc usage must be locked)                                */
+/****************************************************************************************/
+static int _alloc(void **ptr_to_alloc, const u__sz_t len, const int flag)
+{
+    void *ptr                   = NULL;
+
+    u__sz_t len_bis             = (u__sz_t) len;
+    u__sz_t sz                  = 0;
+    u__sz_t cur_free_sz         = 0;
+
+    struct block *b_0           = (struct block *) _start_heap;
+    struct block *b_cur         = NULL;
+    struct block *b_nxt_int     = NULL;
+
+    /* Checking of the validity of the flag */
+    if ((flag != ALLOC_NORMAL) && (flag != ALLOC_SENSITIVE)) {
+        malloc_errno = EHEAPFLAGNOTVALID;
+        goto end_error;
+    }
+
+#if CONFIG_STD_MALLOC_CHECK_IF_NULL == 1
+    /* We check if the pointer has not already been allocated */
+    if (*ptr_to_alloc) {
+        malloc_errno = EHEAPALREADYALLOC;
+        goto end_error;
+    }
+#endif
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 2
+    /* Checking of the heap's integrity */
+    if (_heap_integrity() < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+#if CONFIG_STD_MALLOC_CHECK_STEP > 0
+    /* Incremental checking of the heap's headers */
+    if (_check_step(_get_wmalloc_heap(), CONFIG_STD_MALLOC_CHECK_STEP) < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* We check if there is free block into heap */
+    if (!NB_FREE()) {
+        malloc_errno = EHEAPFULL;
+        goto end_error;
+    }
+
+    /* Allocated block cannot be smaller than a free bock header (think free()...) */
+    if (len_bis < (u__sz_t) DATA_MIN_SZ) {
+        len_bis = (u__sz_t) DATA_MIN_SZ;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    /* The asked length is aligned */
+    len_bis = ALIGN(len_bis);
+#endif
+
+    /* We check that the block size does not exceed the free memory
+     * (this also avoids any overflow when adding the header size) */
+    if ((uint32_t) len_bis + HDR_SZ > (uint32_t) SZ_FREE()) {
+        malloc_errno = EHEAPNOMEM;
+        goto end_error;
+    }
+
+    /* Block size is calculated */
+    sz = (u__sz_t) (len_bis + HDR_SZ);
+
+    /* Looking for a fitting free block (constant time) */
+    if ((b_cur = _tlsf_find(sz)) == NULL) {
+        malloc_errno = EHEAPNOMEM;
+        goto end_error;
+    }
+
+#if CONFIG_STD_MALLOC_INTEGRITY == 1
+    /* We check the integrity of the header (if no heap integrity checking) */
+    if (check_hdr(b_cur, CHECK_ALL_FREE)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* The free block is taken out of its list */
+    _tlsf_remove(b_cur);
+    DECREASE_NB_FREE();
+
+    /* Size of the current free block */
+    cur_free_sz = b_cur->sz;
+
+    /* Pointer to be returned by malloc() */
+    ptr  = (void *) ((struct alloc_block *) b_cur + 1);
+
+    /* If the space after the block to allocate is too small to allocate
+     * another block (it needs at least enough space for header + 1 byte) */
+    if (cur_free_sz - sz < HDR_FREE_SZ) {
+        sz = cur_free_sz;
+    }
+
+    /* Current free block is updated and changed to allocated block */
+    b_cur->sz = sz;
+    MAKE_ALLOC(b_cur);
+#if CANARIS_INTEGRITY == 1
+    UPDATE_CANARI_SZ(b_cur);
+#endif
+
+    /* The remaining space is put back in the corresponding list, and the block
+     * following it (if any) is updated with its size */
+    if (cur_free_sz != sz) {
+        b_nxt_int           = (struct block *) ((physaddr_t) b_cur + sz);
+        b_nxt_int->flag     = 0;
+        b_nxt_int->prv_sz   = sz;
+        b_nxt_int->sz       = (u__sz_t) (cur_free_sz - sz);
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(b_nxt_int);
+#endif
+        _tlsf_insert(b_nxt_int);
+        INCREASE_NB_FREE();
+
+        if (NOT_LAST_BLOCK(b_nxt_int)) {
+            NEXT(b_nxt_int)->prv_sz = SIZE(b_nxt_int);
+#if CANARIS_INTEGRITY == 1
+            UPDATE_CANARI_SZ(NEXT(b_nxt_int));
+#endif
+        }
+    }
+
+    /* RAZ of the whole memory reserved for new allocated block's data */
+    if (flag == ALLOC_SENSITIVE) {
+        MAKE_SENSITIVE(b_cur);
+        _safe_flood_char((char *) ptr, CHAR_WRITTEN, (uint32_t) (sz - HDR_SZ));
+    } else {
+        b_cur->prv_free = 0;
+        b_cur->nxt_free = 0;
+#if (CANARIS_INTEGRITY == 1) && (CONFIG_STD_MALLOC_NB_CANARIES >= 2)
+        b_cur->can_free = 0;
+#endif
+    }
+
+    /* Decrease the total size of free memory */
+    DECREASE_SZ_FREE(sz);
+
+#if CANARIS_INTEGRITY == 1
+    /* b_0 first canari are updated for taking into account the modification of
+     * b_0->prv_sz = NB_FREE() and b_0->sz = SZ_FREE() */
+    UPDATE_CANARI_SZ(b_0);
+#endif
+
+    /**********************************************************/
+    /**********************************************************/
+    /* HERE ALLOCATED POINTER IS SET AND 0 IS RETURNED        */
+    /**********************************************************/
+    *ptr_to_alloc = ptr;
+
+    return 0;
+    /**********************************************************/
+    /**********************************************************/
+
+end_error:
+
+    return -1;
+}
+/****************************************************************************************/
+/*  Bulk functions: pending releases and checks (wmalloc usage must be locked)          */
+/****************************************************************************************/
+int _wmalloc_bulk_begin(struct wheap *heap, const int release)
+{
+    (void) heap;
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(heap);
+#endif
+
+    if (release) {
+#if CONFIG_STD_MALLOC_CHECK_STEP > 0
+        /* Incremental checking of the heap's headers */
+        if (_check_step(heap, CONFIG_STD_MALLOC_CHECK_STEP) < 0) {
+            malloc_errno = EHEAPINTEGRITY;
+            return -1;
+        }
+#endif
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 2
+        /* Checking of the heap's integrity (before the headers of the runs are merged) */
+        if (_heap_integrity() < 0) {
+            malloc_errno = EHEAPINTEGRITY;
+            return -1;
+        }
+#endif
+    }
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Bulk functions: allocation of n blocks of len bytes (wmalloc usage must be locked)  */
+/****************************************************************************************/
+int _wmalloc_bulk_carve(struct wheap *heap, void **ptrs, const uint32_t n, const uint32_t len,
+                        const int flag)
+{
+    void *ptr           = NULL;
+
+    uint32_t len_bis    = len;
+    uint32_t sz         = 0;
+
+    (void) heap;
+
+    /* Each block is sized as by wmalloc() */
+    if (len_bis < (uint32_t) DATA_MIN_SZ) {
+        len_bis = (uint32_t) DATA_MIN_SZ;
+    }
+
+    if (len_bis > (uint32_t) _heap_size) {
+        malloc_errno = EHEAPNOMEM;
+        return -1;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    len_bis = ALIGN(len_bis);
+#endif
+
+    sz = len_bis + HDR_SZ;
+
+    /* The n blocks are carved into one block, which must fit into the heap */
+    if (n > (uint32_t) _heap_size / sz) {
+        malloc_errno = EHEAPNOMEM;
+        return -1;
+    }
+
+    if (_alloc(&ptr, (u__sz_t) (n * sz - HDR_SZ), flag) < 0) {
+        return -1;
+    }
+
+    _carve((struct block *) ((struct alloc_block *) ptr - 1), (u__sz_t) sz, n, ptrs);
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Bulk functions: extension of a run of blocks (wmalloc usage must be locked)         */
+/****************************************************************************************/
+int _wmalloc_bulk_next(struct wheap *heap, void *first, void *last, void *ptr)
+{
+    struct block *b_cur = (struct block *) ((struct alloc_block *) first - 1);
+    struct block *b_lst = (struct block *) ((struct alloc_block *) last - 1);
+    struct block *b_nxt = (struct block *) ((struct alloc_block *) ptr - 1);
+
+    (void) heap;
+
+    /* The first block is checked before the run is extended (the other blocks are
+     * checked by _free()) */
+    if ((b_lst == b_cur) && !_mergeable(b_cur, b_cur)) {
+        return 0;
+    }
+
+    return ((b_nxt == NEXT(b_lst)) && _mergeable(b_cur, b_nxt));
+}
+
+/****************************************************************************************/
+/*  Bulk functions: release of a run of blocks (wmalloc usage must be locked)           */
+/****************************************************************************************/
+int _wmalloc_bulk_free(struct wheap *heap, void **ptrs, const uint32_t n)
+{
+    (void) heap;
+
+    /* The blocks of the run are merged into the first one, which is released */
+    if (n > 1) {
+        _merge((struct block *) ((struct alloc_block *) ptrs[0] - 1),
+               (struct block *) ((struct alloc_block *) ptrs[n - 1] - 1));
+    }
+
+    return _free(ptrs);
+}
+
+/****************************************************************************************/
+/*  Bulk functions: counting of the calls (wmalloc usage must be locked)                */
+/****************************************************************************************/
+void _wmalloc_bulk_stats(struct wheap *heap, const uint32_t nb_allocs, const uint32_t nb_frees,
+                         const uint32_t nb_failed)
+{
+    struct block *b_0 = (struct block *) _start_heap;
+
+    (void) heap;
+
+    _stats.nb_allocs += nb_allocs;
+    _stats.nb_frees  += nb_frees;
+    _stats.nb_failed += nb_failed;
+
+    STATS_MAX_USED();
+}
+
+/****************************************************************************************/
+/*  Aligned malloc() function                                                           */
+/****************************************************************************************/
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_aligned(void **ptr_to_alloc, const uint16_t len, const uint32_t align, const int flag)
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_aligned(void **ptr_to_alloc, const uint32_t len, const uint32_t align, const int flag)
+#endif
+{
+    struct block *b_0   = NULL;
+    void *ptrs[2]       = { NULL, NULL };
+    void *ptr           = NULL;
+
+    uint32_t len_bis    = (uint32_t) len;
+    uint32_t lead       = 0;
+    physaddr_t data     = 0;
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+    /* The default heap is set by the first allocation */
+    LAZY_INIT();
+
+    /* The alignment must be a power of two */
+    if (!align || (align & (align - 1))) {
+        malloc_errno = EHEAPALIGN;
+        return -1;
+    }
+
+#if CONFIG_STD_MALLOC_CHECK_IF_NULL == 1
+    /* We check if the pointer has not already been allocated */
+    if (*ptr_to_alloc) {
+        malloc_errno = EHEAPALREADYALLOC;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Trying to lock of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(_get_wmalloc_heap());
+#endif
+
+    /* The block is sized as by wmalloc() */
+    if (len_bis < (uint32_t) DATA_MIN_SZ) {
+        len_bis = (uint32_t) DATA_MIN_SZ;
+    }
+
+#if CONFIG_STD_MALLOC_ALIGN > 1
+    len_bis = ALIGN(len_bis);
+#endif
+
+    /* The allocated block holds the data at any alignment, after a leading space
+     * large enough for a free block header */
+    if ((align > (uint32_t) _heap_size) ||
+        (len_bis + align + HDR_FREE_SZ + HDR_SZ > (uint32_t) _heap_size)) {
+        malloc_errno = EHEAPNOMEM;
+        goto end_error;
+    }
+
+    if (_alloc(&ptr, (u__sz_t) (len_bis + align - 1 + HDR_FREE_SZ), flag) < 0) {
+        goto end_error;
+    }
+
+    data = ((physaddr_t) ptr + align - 1) & ~((physaddr_t) align - 1);
+
+    if (data != (physaddr_t) ptr) {
+        /* The leading space is carved as a block and released into the free blocks (the
+         * aligned block header is written into the data, already blanked if sensitive) */
+        data = ((physaddr_t) ptr + HDR_FREE_SZ + align - 1) & ~((physaddr_t) align - 1);
+        lead = (uint32_t) (data - (physaddr_t) ptr);
+
+        _carve((struct block *) ((struct alloc_block *) ptr - 1), (u__sz_t) lead, 2, ptrs);
+
+        if (_free(&ptrs[0]) < 0) {
+            goto end_error;
+        }
+
+        ptr = ptrs[1];
+    }
+
+    /* The space left after the data is released too (or merged into the next free block) */
+    if (_resize((struct block *) ((struct alloc_block *) ptr - 1), (u__sz_t) (len_bis + HDR_SZ)) < 0) {
+        goto end_error;
+    }
+
+    *ptr_to_alloc = ptr;
+
+    /* Successful allocation is counted and traced, with its alignment slack */
+    b_0 = (struct block *) _start_heap;
+    STATS_ALLOC();
+    STATS_ALIGNED(lead);
+    TRACE((flag == ALLOC_SENSITIVE ? WMALLOC_TRACE_ALLOC_SENSITIVE : WMALLOC_TRACE_ALLOC),
+          len, ptr);
+
+#if CANARIS_INTEGRITY == 1
+    /* b_0 first canari are updated for taking into account the modification of
+     * b_0->prv_sz = NB_FREE() and b_0->sz = SZ_FREE() */
+    UPDATE_CANARI_SZ(b_0);
+#endif
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+    /* Failed allocation is counted and traced */
+    STATS_FAILED();
+    TRACE_FAILED(WMALLOC_TRACE_ALLOC, len);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+
+/****************************************************************************************/
+/*  Carving of an allocated block into n blocks (wmalloc usage must be locked)          */
+/****************************************************************************************/
+static void _carve(struct block *b_cur, const u__sz_t sz, const uint32_t n, void **ptrs)
+{
+    struct block *b_nxt = NEXT(b_cur);
+    struct block *b     = b_cur;
+
+    /* The last block keeps the remaining space (alignment, or space too small for a
+     * free block left by the allocation) */
+    u__sz_t last_sz     = (u__sz_t) (SIZE(b_cur) - (n - 1) * sz);
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        if (i) {
+            /* The new headers are written into the data of the allocated block (already
+             * blanked if the block is sensitive) */
+            b           = (struct block *) ((physaddr_t) b_cur + i * sz);
+            b->flag     = b_cur->flag;
+            b->prv_sz   = sz;
+            b->prv_free = 0;
+            b->nxt_free = 0;
+#if (CANARIS_INTEGRITY == 1) && (CONFIG_STD_MALLOC_NB_CANARIES >= 2)
+            b->can_free = 0;
+#endif
+        }
+
+        b->sz = (i == n - 1) ? last_sz : sz;
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(b);
+#endif
+
+        ptrs[i] = (void *) ((struct alloc_block *) b + 1);
+    }
+
+    /* The block following the carved ones is updated (prv_sz) */
+    if ((physaddr_t) b_nxt != _end_heap) {
+        b_nxt->prv_sz = last_sz;
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(b_nxt);
+#endif
+    }
+}
+
+
+
+/****************************************************************************************/
+/****************************************************************************************/
+/****************************************************************************************/
+
+
+/****************************************************************************************/
+/****************************************************************************************/
+/*  Checking of a block to be merged into a run (wmalloc usage must be locked)          */
+/****************************************************************************************/
+static int _mergeable(struct block *b_cur, struct block *b)
+{
+    struct block *b_1 = (struct block *) _start_heap + 1;
+
+    if ((b < b_1) || ((physaddr_t) b + HDR_FREE_SZ > _end_heap)) {
+        return 0;
+    }
+
+    /* Only allocated blocks of the same kind are merged (a sensitive run is wiped) */
+    if (BAD_FLAG(b) || !IS_ALLOC(b) || (IS_SENSITIVE(b) != IS_SENSITIVE(b_cur))) {
+        return 0;
+    }
+
+    if ((SIZE(b) < HDR_FREE_SZ) || ((physaddr_t) b + SIZE(b) > _end_heap)) {
+        return 0;
+    }
+
+#if CONFIG_STD_MALLOC_INTEGRITY == 1
+    /* We check the integrity of the header (if no heap integrity checking) */
+    if (check_hdr(b, CHECK_ALL_ALLOC)) {
+        return 0;
+    }
+#endif
+
+    return 1;
+}
+
+/****************************************************************************************/
+/*  Merging of a run of allocated blocks (wmalloc usage must be locked)                 */
+/****************************************************************************************/
+static void _merge(struct block *b_cur, struct block *b_lst)
+{
+    struct block *b     = NEXT(b_cur);
+    struct block *b_nxt = NEXT(b_lst);
+    struct block *b_tmp = NULL;
+
+    /* The headers of the merged blocks are blanked, as they become data of b_cur */
+    while (b != b_nxt) {
+        b_tmp = NEXT(b);
+        _safe_flood_char((char *) b, CHAR_ZERO, HDR_SZ);
+        CHECK_CURSOR_MOVE(b, b_cur);
+        b = b_tmp;
+    }
+
+    b_cur->sz = (u__sz_t) ((physaddr_t) b_nxt - (physaddr_t) b_cur);
+#if CANARIS_INTEGRITY == 1
+    UPDATE_CANARI_SZ(b_cur);
+#endif
+
+    /* The block following the run is updated (prv_sz) */
+    if ((physaddr_t) b_nxt != _end_heap) {
+        b_nxt->prv_sz = SIZE(b_cur);
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(b_nxt);
+#endif
+    }
+}
+/****************************************************************************************/
+int wfree(void **ptr_to_free)
+{
+    void *ptr = NULL;
+#ifdef CONFIG_STD_MALLOC_CACHE
+    int ret   = 0;
+#endif
+
+    /* Errno is initialized to zero */
+    malloc_errno = 0;
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+    /* Small blocks are kept by the cache of the calling context (no locking) */
+    if ((ret = _wmalloc_cache_put(ptr_to_free)) <= 0) {
+        return ret;
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+# ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+        /* The block is released later by the lock holder */
+        return _defer(_get_wmalloc_heap(), ptr_to_free);
+# else
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+# endif
+    }
+#endif
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+    /* Pending releases are done first (the pending blocks which cannot be released are
+     * counted, see wmalloc_stats(), without failing this call) */
+    _drain(_get_wmalloc_heap());
+#endif
+
+#if CONFIG_STD_MALLOC_CHECK_STEP > 0
+    /* Incremental checking of the heap's headers */
+    if (_check_step(_get_wmalloc_heap(), CONFIG_STD_MALLOC_CHECK_STEP) < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* The block is released, then counted and traced */
+    ptr = *ptr_to_free;
+
+    if (_free(ptr_to_free) < 0) {
+        goto end_error;
+    }
+
+    STATS_FREE();
+    TRACE(WMALLOC_TRACE_FREE, 0, ptr);
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+
+
+/****************************************************************************************/
+/*  Release of an allocated block (wmalloc usage must be locked, the caller counts it)  */
+/****************************************************************************************/
+static int _free(void **ptr_to_free)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_1   = b_0 + 1;
+
+    struct block *b_cur = NULL;
+    struct block *b_prv = NULL;
+    struct block *b_nxt = NULL;
+
+    /* We check if the pointer is not null */
+    if (!(*ptr_to_free)) {
+        malloc_errno = EHEAPALREADYFREE;
+        goto end_error;
+    }
+
+    /* We check if the pointer is not out of range */
+    if (((struct alloc_block *) (*ptr_to_free) < (struct alloc_block *) b_1 + 1) ||
+        ((physaddr_t) (*ptr_to_free) > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        goto end_error;
+    }
+
+    /* We get the block structure address from the pointer to be freed;
+     * at the end of the function, b_cur will correspond with the free block,
+     * in taking into account the eventual merging with previous and/or next frees blocks
+     */
+    b_cur = (struct block *) ((struct alloc_block *) (*ptr_to_free) - 1);
+
+    /* We check if the block has not already been freed */
+    if (IS_FREE(b_cur)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 2
+    /* Checking of the heap's integrity */
+    if (_heap_integrity() < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#elif CONFIG_STD_MALLOC_INTEGRITY == 1
+    /* We check the integrity of the header (if no heap integrity checking) */
+    if (check_hdr(b_cur, CHECK_ALL_ALLOC)) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* Block set to "free" */
+    MAKE_FREE(b_cur);
+
+    /* Increase the total size of free memory */
+    INCREASE_SZ_FREE(SIZE(b_cur));
+
+    /* RAZ of the whole memory to free */
+    if (IS_SENSITIVE(b_cur)) {
+        _safe_flood_char((char *) (*ptr_to_free), CHAR_ZERO, (u__sz_t) (b_cur->sz - HDR_SZ));
+        MAKE_NORMAL(b_cur);
+    }
+
+    /* Pointer to allocated block is set to 0 */
+    *ptr_to_free = NULL;
+
+    /**********************************************************************************/
+    /* If the current block is not the first one (i.e the one after b_0),
+     * we check if the previous block is free and thus can be merged */
+    if (b_cur != b_1) {
+
+        b_prv = PREV(b_cur);
+
+#if CONFIG_STD_MALLOC_INTEGRITY == 1
+        /* We check the integrity of the header (if no heap integrity checking) */
+        if (check_hdr(b_prv, CHECK_ALL_FREE)) {
+            malloc_errno = EHEAPINTEGRITY;
+            goto end_error;
+        }
+#endif
+
+        if (IS_FREE(b_prv)) {
+
+            /* The previous block leaves its list (its size is changing) */
+            _tlsf_remove(b_prv);
+            DECREASE_NB_FREE();
+
+            /* Previous block updated (size increased) */
+            b_prv->sz = (u__sz_t) (SIZE(b_prv) + SIZE(b_cur));
+
+            /* RAZ of the current block's header */
+            _safe_flood_char((char *) b_cur, CHAR_ZERO, HDR_SZ);
+            CHECK_CURSOR_MOVE(b_cur, b_prv);
+
+            /* Effective merging */
+            b_cur = b_prv;
+        }
+    }
+
+    /**********************************************************************************/
+    /* If the current block is not the final one,
+     * we check if the block after is free and thus can be merged */
+    if (NOT_LAST_BLOCK(b_cur)) {
+
+        b_nxt = NEXT(b_cur);
+
+#if CONFIG_STD_MALLOC_INTEGRITY == 1
+        /* We check the integrity of the header (if no heap integrity checking) */
+        if (check_hdr(b_nxt, CHECK_ALL_FREE)) {
+            malloc_errno = EHEAPINTEGRITY;
+            goto end_error;
+        }
+#endif
+
+        if (IS_FREE(b_nxt)) {
+
+            /* The next block leaves its list */
+            _tlsf_remove(b_nxt);
+            DECREASE_NB_FREE();
+
+            /* Current block updated (size increased) */
+            b_cur->sz = (u__sz_t) (SIZE(b_cur) + SIZE(b_nxt));
+
+            /* RAZ of tne next block's header */
+            _safe_flood_char((char *) b_nxt, CHAR_ZERO, HDR_FREE_SZ);
+            CHECK_CURSOR_MOVE(b_nxt, b_cur);
+        }
+    }
+
+#if CANARIS_INTEGRITY == 1
+    UPDATE_CANARI_SZ(b_cur);
+#endif
+
+    /* If the updated block is not the final one, the next block is updated (prv_sz) */
+    if (NOT_LAST_BLOCK(b_cur)) {
+        NEXT(b_cur)->prv_sz = b_cur->sz;
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(NEXT(b_cur));
+#endif
+    }
+
+    /* The resulting free block is put in its list */
+    _tlsf_insert(b_cur);
+    INCREASE_NB_FREE();
+
+#if CANARIS_INTEGRITY == 1
+    /* b_0 first canari are updated for taking into account the modification of
+     * b_0->prv_sz = NB_FREE() and b_0->sz = SZ_FREE() */
+    UPDATE_CANARI_SZ(b_0);
+#endif
+
+    return 0;
+
+end_error:
+
+    return -1;
+}
+
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+/****************************************************************************************/
+/*  Deferred release: checks of a block without the lock (see malloc_defer.c)           */
+/****************************************************************************************/
+int _wmalloc_defer_check(struct wheap *heap, const void *ptr)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_1   = b_0 + 1;
+
+    (void) heap;
+
+    /* The headers are checked when the block is really released */
+    if (((struct alloc_block *) ptr < (struct alloc_block *) b_1 + 1) ||
+        ((physaddr_t) ptr + PENDING_LINK_SZ > _end_heap)) {
+        malloc_errno = EHEAPOUTOFRANGE;
+        return -1;
+    }
+
+    if (IS_FREE((struct block *) ((struct alloc_block *) ptr - 1))) {
+        malloc_errno = EHEAPINTEGRITY;
+        return -1;
+    }
+
+    return 0;
+}
+
+/****************************************************************************************/
+/*  Deferred release: release of a pending block (wmalloc usage must be locked)         */
+/****************************************************************************************/
+int _wmalloc_defer_free(struct wheap *heap, void *ptr)
+{
+    (void) heap;
+
+    return _free(&ptr);
+}
+
+/****************************************************************************************/
+/*  Deferred release: counting of the pending releases                                  */
+/****************************************************************************************/
+void _wmalloc_defer_stats(struct wheap *heap, const uint32_t nb_frees, const uint32_t nb_bad)
+{
+    (void) heap;
+
+    _stats.nb_frees += nb_frees;
+
+    STATS_BAD_PENDING(nb_bad);
+}
+#endif
+
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+/****************************************************************************************/
+/*  Data length of a block which can be cached (0 if it must be released by the heap)  */
+/****************************************************************************************/
+uint32_t _wmalloc_cache_len(const void *ptr)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_cur = NULL;
+
+    /* Only the checks which do not need wmalloc usage to be locked are done here (the
+     * block being owned by the caller, its flag and size cannot be modified meanwhile),
+     * the headers being checked when the block is really released */
+    if (!ptr || ((struct alloc_block *) ptr < (struct alloc_block *) (b_0 + 1) + 1) ||
+        ((physaddr_t) ptr > _end_heap)) {
+        return 0;
+    }
+
+    b_cur = (struct block *) ((struct alloc_block *) ptr - 1);
+
+    if (BAD_FLAG(b_cur) || !IS_ALLOC(b_cur) || !IS_NORMAL(b_cur)) {
+        return 0;
+    }
+
+    if ((SIZE(b_cur) <= HDR_SZ) || ((physaddr_t) b_cur + SIZE(b_cur) > _end_heap)) {
+        return 0;
+    }
+
+    return (uint32_t) (SIZE(b_cur) - HDR_SZ);
+}
+#endif
+
+
+#if CONFIG_STD_MALLOC_INTEGRITY != 0
+/****************************************************************************************/
+/*  Reallocation: checks of the header of an allocated block (see malloc_realloc.c)     */
+/****************************************************************************************/
+int _wmalloc_check_hdr(struct wheap *heap, const void *ptr, const u__sz_t flag)
+{
+    (void) heap;
+
+    return check_hdr((struct block *) ((struct alloc_block *) ptr - 1), flag);
+}
+#endif
+
+/****************************************************************************************/
+/*  Reallocation: in place resizing of a block (wmalloc usage must be locked)           */
+/****************************************************************************************/
+int _wmalloc_resize(struct wheap *heap, void *ptr, const u__sz_t sz)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    int ret             = 0;
+
+    (void) heap;
+
+    if ((ret = _resize((struct block *) ((struct alloc_block *) ptr - 1), sz))) {
+        return ret;
+    }
+
+    /* The allocated memory may have grown */
+    STATS_MAX_USED();
+
+#if CANARIS_INTEGRITY == 1
+    /* b_0 first canari are updated for taking into account the modification of
+     * b_0->prv_sz = NB_FREE() and b_0->sz = SZ_FREE() */
+    UPDATE_CANARI_SZ(b_0);
+#endif
+
+    return 0;
+}
+
+
+
+/****************************************************************************************/
+
+/* Resizing of an allocated block in place, using the next block if it is free
+ * (returns 1 if the block cannot be resized in place) */
+static int _resize(struct block *b_cur, u__sz_t sz)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_nxt = NULL;
+    struct block *b_rem = NULL;
+
+    u__sz_t cur_sz      = SIZE(b_cur);
+    u__sz_t max_sz      = cur_sz;
+
+    /* The next block can be used if it is free */
+    if (NOT_LAST_BLOCK(b_cur)) {
+
+        b_nxt = NEXT(b_cur);
+
+#if CONFIG_STD_MALLOC_INTEGRITY == 1
+        /* We check the integrity of the header (if no heap integrity checking) */
+        if (check_hdr(b_nxt, CHECK_ALL_FREE)) {
+            malloc_errno = EHEAPINTEGRITY;
+            return -1;
+        }
+#endif
+
+        if (IS_FREE(b_nxt)) {
+            max_sz = (u__sz_t) (max_sz + SIZE(b_nxt));
+        } else {
+            b_nxt = NULL;
+        }
+    }
+
+    if (sz > max_sz) {
+        return 1;
+    }
+
+    /* If the remaining space is too small for a free block, it is kept in the block */
+    if (max_sz - sz < HDR_FREE_SZ) {
+        sz = max_sz;
+    }
+
+    /* Nothing to do if the block size does not change */
+    if (sz == cur_sz) {
+        return 0;
+    }
+
+    /* The next free block leaves its list (it is merged into the block or
+     * into the remaining free block) */
+    if (b_nxt) {
+        _tlsf_remove(b_nxt);
+        DECREASE_NB_FREE();
+        DECREASE_SZ_FREE(SIZE(b_nxt));
+
+        /* The incremental checking cursor must not point to the vanishing header */
+        CHECK_CURSOR_MOVE(b_nxt, b_cur);
+    }
+
+    if (sz > cur_sz) {
+        /* RAZ of the memory added to the block's data (or at least of the
+         * former next block's header) */
+        if (IS_SENSITIVE(b_cur)) {
+            _safe_flood_char((char *) b_cur + cur_sz, CHAR_WRITTEN, (uint32_t) (sz - cur_sz));
+        } else {
+            _safe_flood_char((char *) b_nxt, CHAR_ZERO,
+                             (uint32_t) (sz - cur_sz < HDR_FREE_SZ ? sz - cur_sz : HDR_FREE_SZ));
+        }
+    } else if (IS_SENSITIVE(b_cur)) {
+        /* RAZ of the memory given back */
+        _safe_flood_char((char *) b_cur + sz, CHAR_ZERO, (uint32_t) (cur_sz - sz));
+    }
+
+    b_cur->sz = sz;
+#if CANARIS_INTEGRITY == 1
+    UPDATE_CANARI_SZ(b_cur);
+#endif
+
+    /* The remaining space is a new free block */
+    if (max_sz - sz) {
+
+        b_rem = NEXT(b_cur);
+
+        b_rem->flag   = 0;
+        b_rem->prv_sz = sz;
+        b_rem->sz     = (u__sz_t) (max_sz - sz);
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(b_rem);
+#endif
+
+        _tlsf_insert(b_rem);
+        INCREASE_NB_FREE();
+        INCREASE_SZ_FREE(SIZE(b_rem));
+
+        b_cur = b_rem;
+    }
+
+    /* If the updated block is not the final one, the next block is updated (prv_sz) */
+    if (NOT_LAST_BLOCK(b_cur)) {
+        NEXT(b_cur)->prv_sz = b_cur->sz;
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_SZ(NEXT(b_cur));
+#endif
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************************/
+/****************************************************************************************/
+/****************************************************************************************/
+
+/* First and second level indexes of the list holding the blocks of the given size */
+static inline void _tlsf_mapping(uint32_t sz, uint8_t *fl, uint8_t *sl)
+{
+    uint8_t f;
+
+    if (sz < SMALL_BLOCK_SZ) {
+        *fl = 0;
+        *sl = (uint8_t) (sz >> GRANULE_LOG2);
+        return;
+    }
+
+    f   = (uint8_t) LOG2(sz);
+    *sl = (uint8_t) ((sz >> (f - SL_INDEX_LOG2)) ^ SL_COUNT);
+    *fl = (uint8_t) (f - FL_INDEX_SHIFT + 1);
+}
+
+/****************************************************************************************/
+
+/* Free block fitting the given size, or NULL if there is none.
+ * The size is rounded up to the next list boundary, so that any block of
+ * the first non-empty list found from there is large enough: there is no
+ * search loop at all */
+static struct block *_tlsf_find(u__sz_t sz)
+{
+    uint32_t rsz = sz;
+    uint32_t map = 0;
+
+    uint8_t  fl, sl;
+
+    if (rsz < SMALL_BLOCK_SZ) {
+        rsz = (rsz + (1 << GRANULE_LOG2) - 1) & ~((uint32_t) (1 << GRANULE_LOG2) - 1);
+    } else {
+        rsz += ((uint32_t) 1 << (LOG2(rsz) - SL_INDEX_LOG2)) - 1;
+        if (rsz < sz) {
+            return NULL;
+        }
+    }
+
+    _tlsf_mapping(rsz, &fl, &sl);
+    if (fl >= FL_COUNT) {
+        return NULL;
+    }
+
+    /* First non-empty list of the same first level... */
+    map = _sl_map[fl] & (~((uint32_t) 0) << sl);
+
+    /* ... or of the next non-empty first level */
+    if (!map) {
+        map = _fl_map & (~((uint32_t) 0) << (fl + 1));
+        if (!map) {
+            return NULL;
+        }
+        fl  = FIRST_BIT(map);
+        map = _sl_map[fl];
+    }
+    sl = FIRST_BIT(map);
+
+    STATS_SCAN();
+    return BLOCK(_lists[fl][sl]);
+}
+
+/****************************************************************************************/
+
+/* Free block is inserted at the head of its list */
+static void _tlsf_insert(struct block *b_cur)
+{
+    uint8_t fl, sl;
+
+    _tlsf_mapping(SIZE(b_cur), &fl, &sl);
+
+    b_cur->prv_free = 0;
+    b_cur->nxt_free = _lists[fl][sl];
+
+    if (_lists[fl][sl]) {
+        NXT_FREE(b_cur)->prv_free = OFFSET(b_cur);
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_FREE(NXT_FREE(b_cur));
+#endif
+    }
+
+#if CANARIS_INTEGRITY == 1
+    UPDATE_CANARI_FREE(b_cur);
+#endif
+
+    _lists[fl][sl] = OFFSET(b_cur);
+    _sl_map[fl] |= ((uint32_t) 1 << sl);
+    _fl_map     |= ((uint32_t) 1 << fl);
+}
+
+/****************************************************************************************/
+
+/* Free block is unlinked from its list (must be called before any size modification) */
+static void _tlsf_remove(struct block *b_cur)
+{
+    uint8_t fl, sl;
+
+    _tlsf_mapping(SIZE(b_cur), &fl, &sl);
+
+    if (b_cur->prv_free) {
+        PRV_FREE(b_cur)->nxt_free = b_cur->nxt_free;
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_FREE(PRV_FREE(b_cur));
+#endif
+    } else {
+        _lists[fl][sl] = b_cur->nxt_free;
+    }
+
+    if (b_cur->nxt_free) {
+        NXT_FREE(b_cur)->prv_free = b_cur->prv_free;
+#if CANARIS_INTEGRITY == 1
+        UPDATE_CANARI_FREE(NXT_FREE(b_cur));
+#endif
+    }
+
+    if (!_lists[fl][sl]) {
+        _sl_map[fl] &= ~((uint32_t) 1 << sl);
+        if (!_sl_map[fl]) {
+            _fl_map &= ~((uint32_t) 1 << fl);
+        }
+    }
+}
+
+
+/****************************************************************************************/
+/*  Statistics                                                                          */
+/****************************************************************************************/
+int wmalloc_stats(struct wmalloc_stats *stats)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_cur = NULL;
+
+    uint8_t fl, sl;
+
+    if (!stats) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 2
+    /* Checking of the heap's integrity */
+    if (_heap_integrity() < 0) {
+        malloc_errno = EHEAPINTEGRITY;
+        goto end_error;
+    }
+#endif
+
+    /* Counters are maintained by the allocator functions, the other values are
+     * read from b_0 */
+    stats->heap_sz          = (uint32_t) _heap_size;
+    stats->used_sz          = USED_SZ();
+    stats->free_sz          = (uint32_t) SZ_FREE();
+    stats->max_used_sz      = _stats.max_used_sz;
+    stats->largest_free_sz  = 0;
+    stats->nb_free_blocks   = (uint32_t) NB_FREE();
+    stats->nb_allocs        = _stats.nb_allocs;
+    stats->nb_frees         = _stats.nb_frees;
+    stats->nb_failed        = _stats.nb_failed;
+    stats->nb_aligned       = _stats.nb_aligned;
+    stats->align_slack_sz   = _stats.align_slack_sz;
+    stats->nb_scanned       = _stats.nb_scanned;
+    stats->nb_bad_pending   = _stats.nb_bad_pending;
+
+    /* The largest free block is in the last non-empty list, which is read */
+    if (_fl_map) {
+        fl    = (uint8_t) LOG2(_fl_map);
+        sl    = (uint8_t) LOG2(_sl_map[fl]);
+        b_cur = BLOCK(_lists[fl][sl]);
+    }
+
+    while (b_cur) {
+        if (OFFSET(b_cur) > OFFSET_MAX) {
+            malloc_errno = EHEAPINTEGRITY;
+            goto end_error;
+        }
+
+        if (SIZE(b_cur) > stats->largest_free_sz) {
+            stats->largest_free_sz = (uint32_t) SIZE(b_cur);
+        }
+
+        b_cur = (b_cur->nxt_free ? NXT_FREE(b_cur) : NULL);
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+
+end_error:
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage (malloc_errno is not modified in order to keep the value
+     * of the initial error) */
+    semaphore_release((volatile uint32_t *) _ptr_semaphore);
+#endif
+
+    return -1;
+}
+
+
+/****************************************************************************************/
+/****************************************************************************************/
+/****************************************************************************************/
+
+/****************************************************************************************/
+/*  Checking of the heap's integrity                                                    */
+/****************************************************************************************/
+#if CONFIG_STD_MALLOC_INTEGRITY >= 2
+int _heap_integrity(void)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_cur = NULL;
+
+    u__sz_t nb_free     = 0;
+    u__sz_t sz_free     = 0;
+
+    uint8_t i, j, fl, sl;
+
+    int error           = 0;
+
+    /* We check the integrity of the initial block's header */
+    if ((error = check_hdr(b_0, CHECK_CANARI)) ||
+        (SZ_FREE() > _heap_size - HDR_FREE_SZ)) {
+        return (error ? error : INTEGRITY_B_0);
+    }
+
+    /* All free block headers are checked, list by list */
+    for (i = 0; i < FL_COUNT; ++i) {
+
+        if (((_fl_map >> i) & 1) != (_sl_map[i] != 0)) {
+            return INTEGRITY_B_0;
+        }
+
+        for (j = 0; j < SL_COUNT; ++j) {
+
+            if (!_lists[i][j]) {
+                if (_sl_map[i] & ((uint32_t) 1 << j)) {
+                    return INTEGRITY_B_0;
+                }
+                continue;
+            }
+
+            if (!(_sl_map[i] & ((uint32_t) 1 << j)) || BLOCK(_lists[i][j])->prv_free) {
+                return INTEGRITY_PRV_FREE;
+            }
+
+            b_cur = BLOCK(_lists[i][j]);
+
+            while (1) {
+
+                if ((OFFSET(b_cur) > OFFSET_MAX) || (OFFSET(b_cur) < HDR_FREE_SZ)) {
+                    return INTEGRITY_NXT_FREE;
+                }
+
+                if (IS_ALLOC(b_cur)) {
+                    return INTEGRITY_FLAG;
+                }
+
+                if ((error = check_hdr(b_cur, CHECK_ALL_FREE))) {
+                    return error;
+                }
+
+                /* A free block must be in the list of its size */
+                _tlsf_mapping(SIZE(b_cur), &fl, &sl);
+                if ((fl != i) || (sl != j)) {
+                    return INTEGRITY_SZ;
+                }
+
+                ++nb_free;
+                sz_free = (u__sz_t) (sz_free + SIZE(b_cur));
+                if (nb_free > NB_FREE()) {
+                    return INTEGRITY_NB_FREE;
+                }
+
+                if (!b_cur->nxt_free) {
+                    break;
+                }
+
+                if (NXT_FREE(b_cur)->prv_free != OFFSET(b_cur)) {
+                    return INTEGRITY_FREE_NEQ_NXT;
+                }
+
+                b_cur = NXT_FREE(b_cur);
+            }
+        }
+    }
+
+    /* We check the equality between the number of free blocks (and the free memory)
+     * indicated in b_0 and the calculated ones */
+    if (nb_free != NB_FREE()) {
+        return INTEGRITY_NB_FREE;
+    }
+    if (sz_free != SZ_FREE()) {
+        return INTEGRITY_SZ_FREE;
+    }
+
+#if CONFIG_STD_MALLOC_INTEGRITY == 3
+    /* All allocated block headers are checked */
+    b_cur = b_0 + 1;
+
+    while ((physaddr_t) b_cur != _end_heap) {
+
+        if (IS_ALLOC(b_cur)) {
+            if ((error = check_hdr(b_cur, CHECK_ALL_ALLOC))) {
+                return error;
+            }
+        }
+
+        b_cur = NEXT(b_cur);
+    }
+#endif
+
+    return 0;
+}
+#endif
+
+/****************************************************************************************/
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+/* Incremental checking of one header (see malloc_check.c, which keeps the cursor):
+ * off is the offset of the header to check (0 for b_0), *nxt is set to the offset
+ * of the next one (0 after the last block, ending the pass) */
+int _check_block(struct wheap *heap, const u_off_t off, u_off_t *nxt)
+{
+    struct block *b_0   = (struct block *) _start_heap;
+    struct block *b_cur = NULL;
+
+    int error           = 0;
+
+    /* Only the default heap exists (its descriptor only holds the cursor here) */
+    (void) heap;
+
+    /* A new pass begins with the initial block's header */
+    if (!off) {
+        if ((error = check_hdr(b_0, CHECK_CANARI)) ||
+            (SZ_FREE() > _heap_size - HDR_FREE_SZ)) {
+            return (error ? error : INTEGRITY_B_0);
+        }
+        *nxt = OFFSET(b_0 + 1);
+        return 0;
+    }
+
+    b_cur = BLOCK(off);
+
+    if (IS_FREE(b_cur)) {
+        if ((error = check_hdr(b_cur, CHECK_ALL_FREE))) {
+            return error;
+        }
+        /* The list is terminated by 0 on both sides */
+        if (b_cur->prv_free && (PRV_FREE(b_cur)->nxt_free != OFFSET(b_cur))) {
+            return INTEGRITY_FREE_NEQ_PRV;
+        }
+        if (b_cur->nxt_free && (NXT_FREE(b_cur)->prv_free != OFFSET(b_cur))) {
+            return INTEGRITY_FREE_NEQ_NXT;
+        }
+    } else if ((error = check_hdr(b_cur, CHECK_ALL_ALLOC))) {
+        return error;
+    }
+
+    /* The size must lead to the next header (or to the end of the heap) */
+    if ((SIZE(b_cur) < HDR_FREE_SZ) ||
+        ((uint32_t) OFFSET(b_cur) + SIZE(b_cur) > (uint32_t) _heap_size)) {
+        return INTEGRITY_SZ;
+    }
+
+    if (LAST_BLOCK(b_cur)) {
+        *nxt = 0;
+        return 0;
+    }
+
+    if (PRV_SIZE(NEXT(b_cur)) != SIZE(b_cur)) {
+        return INTEGRITY_SZ_NEQ_NXT;
+    }
+
+    *nxt = OFFSET(NEXT(b_cur));
+
+    return 0;
+}
+#endif
+
+/****************************************************************************************/
+
+#if CONFIG_STD_MALLOC_INTEGRITY != 0
+/* Static function for header checking (canaris and sizes) */
+static int check_hdr(struct block *b, u__sz_t flag)
+{
+    /* Checking of the flag */
+    if (BAD_FLAG(b)) {
+        return INTEGRITY_FLAG;
+    }
+
+#if CANARIS_INTEGRITY == 1
+    if (flag & CHECK_CANARI) {
+        if (BAD_CANARI(b)) {
+            return INTEGRITY_CANARI;
+        }
+    }
+#endif
+
+    /* Block 0 has no physical neighbours */
+    if ((physaddr_t) b == _start_heap) {
+        return 0;
+    }
+
+    if (flag & CHECK_SZ_CUR) {
+        if ((SIZE(b) < HDR_FREE_SZ) ||
+            ((uint32_t) OFFSET(b) + SIZE(b) > (uint32_t) _heap_size)) {
+            return INTEGRITY_SZ;
+        }
+    }
+
+    if (flag & CHECK_SZ_PRV) {
+        if ((PRV_SIZE(b) < HDR_FREE_SZ) || (PRV_SIZE(b) > OFFSET(b))) {
+            return INTEGRITY_PRV_SZ;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+
+/****************************************************************************************/
+/****************************************************************************************/
+/****************************************************************************************/
+
+
+#ifdef PRINT_HEAP
+int print_heap(void)
+{
+    struct block *b_0 = (struct block *) _start_heap;
+    struct block *b_cur = NULL;
+
+    printf("%x  _start_heap\n\r", _start_heap);
+
+    b_cur = b_0;
+
+    while ((physaddr_t) b_cur < _end_heap) {
+
+        printf("%x", (physaddr_t) b_cur);
+
+        if IS_ALLOC(b_cur) {
+            printf("    allocated  %d\n\r", SIZE(b_cur));
+        } else if (b_cur != b_0) {
+            printf("    free       %d\n\r", SIZE(b_cur));
+        } else {
+            printf("    blocked    %d\n\r", SIZE(b_cur));
+        }
+
+        b_cur = NEXT(b_cur);
+    }
+
+    printf("%x  _end_heap\n\r", _end_heap);
+
+    return 0;
+}
+#endif
+
+
+#endif
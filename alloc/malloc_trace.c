@@ -0,0 +1,112 @@
+/* Author: Christophe GUNST (christop.gh@gmail.com)
+ *
+ * (implementation of an allocator for the WooKey project)
+ */
+
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_MALLOC_TRACE
+
+#include "malloc_priv.h"
+#include "libc/syscall.h"
+
+
+/* Trace structure :
+ * - the calls to wmalloc(), wfree() and wrealloc() are recorded into a static
+ *   ring buffer of CONFIG_STD_MALLOC_TRACE_LEN records
+ * - records are written by the allocator functions while wmalloc usage is
+ *   locked, and removed by wmalloc_trace_read() (oldest ones first)
+ * - when the buffer is full, the oldest record is overwritten and counted as
+ *   lost, so that the end of a run is always kept
+ */
+
+#define TRACE_LEN           CONFIG_STD_MALLOC_TRACE_LEN
+
+
+/* Global variables */
+
+static struct wmalloc_trace_rec _trace[TRACE_LEN];
+
+static uint32_t _trace_first;       /* Index of the oldest record */
+static uint32_t _trace_nb;          /* Number of records */
+static uint32_t _trace_lost;        /* Number of overwritten records */
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+/* Semaphore (address of the wmalloc semaphore, set by _set_wmalloc_semaphore()) */
+static volatile uint32_t _ptr_semaphore;
+#endif
+
+
+/*********************************************************************************************/
+/*  Recording of a call (wmalloc usage must be locked)                                       */
+/*********************************************************************************************/
+void _wmalloc_trace(const uint8_t op, const uint32_t len, const uint32_t off)
+{
+    struct wmalloc_trace_rec *rec = NULL;
+    uint64_t tick = 0;
+
+    if (_trace_nb == TRACE_LEN) {
+        _trace_first = (_trace_first + 1) % TRACE_LEN;
+        --_trace_nb;
+        ++_trace_lost;
+    }
+
+    rec = &_trace[(_trace_first + _trace_nb) % TRACE_LEN];
+    ++_trace_nb;
+
+    /* The timestamp is only informative: it is left null if the syscall fails */
+    if (sys_get_systick(&tick, PREC_MICRO) != SYS_E_DONE) {
+        tick = 0;
+    }
+
+    rec->tick = (uint32_t) tick;
+    rec->len  = len;
+    rec->off  = off;
+    rec->op   = op;
+}
+
+/*********************************************************************************************/
+/*  Reading of the recorded calls                                                            */
+/*********************************************************************************************/
+int wmalloc_trace_read(struct wmalloc_trace_rec *recs, const uint32_t nb,
+                       uint32_t *nb_read, uint32_t *nb_lost)
+{
+    uint32_t i;
+
+    if (!recs || !nb_read || !nb_lost) {
+        malloc_errno = EMEMDESTNULL;
+        return -1;
+    }
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    _set_wmalloc_semaphore(&_ptr_semaphore);
+
+    /* Locking of wmalloc usage */
+    if (!semaphore_trylock((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPLOCKED;
+        return -1;
+    }
+#endif
+
+    for (i = 0; (i < nb) && _trace_nb; i++) {
+        recs[i] = _trace[_trace_first];
+        _trace_first = (_trace_first + 1) % TRACE_LEN;
+        --_trace_nb;
+    }
+
+    *nb_read = i;
+    *nb_lost = _trace_lost;
+    _trace_lost = 0;
+
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    /* Unlocking of wmalloc usage */
+    if (!semaphore_release((volatile uint32_t *) _ptr_semaphore)) {
+        malloc_errno = EHEAPSEMAPHORE;
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+#endif
@@ -66,8 +66,7 @@
                                            1 - heap is read from start and from end in the
                                                same time in order to find a fit free block
                                                more rapidly (0 else)
-                                           2 - heap is read from start and end alternatively
-                                               [NOT WORKING] */
+                                           2 - heap is read from start and end alternatively */
 #define FREE_MEMORY_CHECK           0   /* Check the real available memory:
                                            0 - never
                                            1 - when starting malloc()
@@ -42,6 +42,8 @@
 
 int wmalloc_init(void);
 
+int wmalloc_dump_layout(void);
+
 #if CONFIG_STD_MALLOC_SIZE_LEN == 16
 int wmalloc(void **ptr_to_alloc, const uint16_t len, const int flag);
 #elif CONFIG_STD_MALLOC_SIZE_LEN == 32
@@ -50,6 +52,158 @@ int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag);
 
 int wfree(void **ptr_to_free);
 
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_aligned(void **ptr_to_alloc, const uint16_t len, const uint32_t align, const int flag);
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_aligned(void **ptr_to_alloc, const uint32_t len, const uint32_t align, const int flag);
+#endif
+
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_bulk(void **ptrs, const uint32_t n, const uint16_t len, const int flag);
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_bulk(void **ptrs, const uint32_t n, const uint32_t len, const int flag);
+#endif
+
+int wfree_bulk(void **ptrs, const uint32_t n);
+
+#ifdef CONFIG_STD_MALLOC_DEFERRED_FREE
+int wmalloc_drain(void);
+#endif
+
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wrealloc(void **ptr_to_realloc, const uint16_t len);
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wrealloc(void **ptr_to_realloc, const uint32_t len);
+#endif
+
+int wmalloc_usable_size(const void *ptr, uint32_t *len);
+
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wmalloc_trim(void *ptr, const uint16_t len);
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wmalloc_trim(void *ptr, const uint32_t len);
+#endif
+
+
+#if defined(CONFIG_STD_MALLOC_LIGHT) || defined(CONFIG_STD_MALLOC_STD)
+/* Independent heaps (each one with its own lock, wmalloc() using the default heap) */
+
+typedef struct wheap wheap_t;
+
+int wheap_init(wheap_t **heap, void *region, const uint32_t size);
+
+#if CONFIG_STD_MALLOC_SIZE_LEN == 16
+int wheap_alloc(wheap_t *heap, void **ptr_to_alloc, const uint16_t len, const int flag);
+#elif CONFIG_STD_MALLOC_SIZE_LEN == 32
+int wheap_alloc(wheap_t *heap, void **ptr_to_alloc, const uint32_t len, const int flag);
+#endif
+
+int wheap_free(wheap_t *heap, void **ptr_to_free);
+#endif
+
+
+/* Fixed-size objects pools (carved into one wmalloc() region) */
+
+typedef struct wpool wpool_t;
+
+int wpool_create(wpool_t **pool, const uint32_t obj_size, const uint32_t count, const int flag);
+
+int wpool_destroy(wpool_t **pool);
+
+int wpool_alloc(wpool_t *pool, void **ptr_to_alloc);
+
+int wpool_free(wpool_t *pool, void **ptr_to_free);
+
+
+/* Arenas (bump allocation into a wmalloc() or static region, bulk release) */
+
+typedef struct warena {
+#ifdef CONFIG_STD_MALLOC_MUTEX
+    volatile uint32_t lock;
+#endif
+    uint8_t  *start;        /* Region given to warena_init() */
+    uint32_t  size;         /* Region size */
+    uint32_t  used;         /* Used part of the region */
+    int       flag;         /* ALLOC_NORMAL or ALLOC_SENSITIVE (wiped at reset) */
+} warena_t;
+
+int warena_init(warena_t *arena, void *region, const uint32_t size, const int flag);
+
+int warena_alloc(warena_t *arena, void **ptr_to_alloc, const uint32_t len);
+
+int warena_reset(warena_t *arena);
+
+
+/* Heap statistics (sizes are in bytes, blocks headers included) */
+
+struct wmalloc_stats {
+    uint32_t heap_sz;           /* Heap size (block 0 included) */
+    uint32_t used_sz;           /* Allocated memory */
+    uint32_t free_sz;           /* Free memory */
+    uint32_t max_used_sz;       /* High-water mark of the allocated memory */
+    uint32_t largest_free_sz;   /* Size of the largest free block */
+    uint32_t nb_free_blocks;    /* Number of free blocks */
+    uint32_t nb_allocs;         /* Number of successful allocations */
+    uint32_t nb_frees;          /* Number of successful releases */
+    uint32_t nb_failed;         /* Number of failed allocations */
+    uint32_t nb_aligned;        /* Number of successful wmalloc_aligned() calls */
+    uint32_t align_slack_sz;    /* Leading space skipped by wmalloc_aligned() (given back) */
+    uint32_t nb_scanned;        /* Free blocks (or free runs) read by the wmalloc() searches */
+    uint32_t nb_bad_pending;    /* Deferred releases which could not be done (see wfree()) */
+};
+
+int wmalloc_stats(struct wmalloc_stats *stats);
+
+
+#if CONFIG_STD_MALLOC_INTEGRITY >= 1
+/* Incremental integrity checking (e.g. from idle loops) */
+
+int wmalloc_check_step(const uint32_t budget);
+#endif
+
+
+#ifdef CONFIG_STD_MALLOC_CACHE
+/* Small blocks caches (one for the main thread, then one per ISR slot, an ISR
+ * using the slot 1 + irq % CONFIG_STD_MALLOC_CACHE_ISR_SLOTS) */
+
+#define WMALLOC_CACHE_MAIN      0
+
+struct wmalloc_cache_stats {
+    uint32_t nb_hits;           /* Allocations served by the cache */
+    uint32_t nb_misses;         /* Allocations of a cached size served by the heap */
+    uint32_t nb_cached;         /* Releases kept by the cache */
+    uint32_t nb_overflows;      /* Releases given to the heap, the size class being full */
+    uint32_t nb_blocks;         /* Blocks currently held by the cache */
+};
+
+int wmalloc_cache_flush(void);
+
+int wmalloc_cache_stats(const uint32_t ctx, struct wmalloc_cache_stats *stats);
+#endif
+
+
+#ifdef CONFIG_STD_MALLOC_TRACE
+
+/* Allocation trace (values for op, WMALLOC_TRACE_FAILED being or'ed) */
+
+#define WMALLOC_TRACE_ALLOC             0x01    /* wmalloc() with ALLOC_NORMAL */
+#define WMALLOC_TRACE_ALLOC_SENSITIVE   0x02    /* wmalloc() with ALLOC_SENSITIVE */
+#define WMALLOC_TRACE_FREE              0x03    /* wfree() */
+#define WMALLOC_TRACE_REALLOC           0x04    /* wrealloc() resizing the block in place */
+#define WMALLOC_TRACE_FAILED            0x80    /* Call returned -1 */
+
+struct __attribute__((packed)) wmalloc_trace_rec {
+    uint32_t tick;          /* Systick (microseconds, low 32 bits) */
+    uint32_t len;           /* Asked length (0 for wfree()) */
+    uint32_t off;           /* Offset of the data from the heap start (0 if failed) */
+    uint8_t  op;            /* WMALLOC_TRACE_* */
+};
+
+int wmalloc_trace_read(struct wmalloc_trace_rec *recs, const uint32_t nb,
+                       uint32_t *nb_read, uint32_t *nb_lost);
+
+#endif
+
 
 #endif
 
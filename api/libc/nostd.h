@@ -24,6 +24,7 @@
 #ifndef NOSTD_H_
 #define NOSTD_H_
 
+#include "autoconf.h"
 #include "libc/types.h"
 
 /**
@@ -76,8 +77,10 @@ int hexdump(const uint8_t *bin, int len);
  *  generating an immediate stop of the fmt parsing.
  *
  * As the implementation is asyncrhonous, the generated string is keeped in
- * the local ring buffer, making the aprintf() function eligible in ISR
- * execution.
+ * a local lock-free ring, making the aprintf() function eligible in ISR
+ * execution (concurrent calls do not fail, each message being recorded
+ * whole, up to 255 chars). When the ring is full, the message is dropped,
+ * counted, and -1 is returned.
  *
  * WARNING: the userspace implementation is responsible for regulary flushging
  * the ring buffer using the aprintf_flush() API in the main thread execution
@@ -95,4 +98,79 @@ int aprintf(const char *fmt, ...);
  */
 int aprintf_flush(void);
 
+/*
+ * sending the printf() output kept in the printf buffer
+ * (CONFIG_STD_PRINTF_BUFFERED), nothing being kept otherwise.
+ * Returns -1 if the buffer is in use by another context.
+ */
+int printf_flush(void);
+
+/*
+ * asynchronous printf ring counters, permitting to size the ring
+ * (CONFIG_STD_APRINTF_RING_SIZE)
+ */
+struct aprintf_stats {
+    uint32_t nb_records;    /* messages recorded */
+    uint32_t nb_dropped;    /* messages dropped, the ring being full */
+    uint32_t max_used_sz;   /* high-water mark of the ring at flush time */
+    uint32_t ring_sz;       /* ring size (bytes) */
+};
+
+int aprintf_stats(struct aprintf_stats *stats);
+
+#ifdef CONFIG_STD_PRINTF_DEFERRED
+/*
+ * Deferred binary logging.
+ *
+ * bprintf() takes the same format strings as printf(), but does not
+ * format anything on the device: it only records the format string
+ * address and the raw arguments into a local ring, at the cost of a few
+ * stores, making it eligible in ISR execution. The records are sent to
+ * the kernel log by bprintf_flush() (hex encoded, one log line each) or
+ * read by bprintf_read(), and turned back into text on the host by
+ * tools/bprintf_decode.py, using the task ELF file.
+ *
+ * Restrictions:
+ * - fmt must be a string literal (it is placed into the .bprintf_fmt
+ *   section, which the linker script may keep out of the loaded image)
+ * - at most BPRINTF_MAX_ARGS arguments, each recorded as one 32 bits
+ *   word: 'll' conversions are not supported
+ * - a '%s' argument is only decoded if it points to a constant string
+ *   of the ELF file
+ *
+ * When the ring is full, or used by another context, the record is
+ * dropped and counted as lost: bprintf() returns -1 and never waits.
+ */
+#define BPRINTF_MAX_ARGS    8
+
+#define bprintf(fmt, ...) \
+    ({ \
+        static const char __bprintf_fmt[] \
+            __attribute__((section(".bprintf_fmt"), used)) = fmt; \
+        _Static_assert(__BPRINTF_NARGS(__VA_ARGS__) <= BPRINTF_MAX_ARGS, \
+                       "bprintf(): too many arguments"); \
+        _bprintf(__bprintf_fmt, __BPRINTF_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+    })
+
+/* number of arguments of the bprintf() macro, whatever it is (any scalar
+ * converts to _Bool, and the arguments are not evaluated by sizeof) */
+#define __BPRINTF_NARGS(...) \
+    ((uint32_t) (sizeof((_Bool[]) { 0, ##__VA_ARGS__ }) - 1))
+
+int _bprintf(const char *fmt, const uint32_t nargs, ...);
+
+/*
+ * sending the recorded calls to the kernel log. Must be called in the
+ * main thread execution context.
+ */
+int bprintf_flush(void);
+
+/*
+ * reading the recorded calls (whole records, as 32 bits words) and the
+ * number of records lost since the previous read or flush.
+ */
+int bprintf_read(uint32_t *words, const uint32_t nb, uint32_t *nb_read,
+                 uint32_t *nb_lost);
+#endif
+
 #endif/*!NOSTD_H_*/
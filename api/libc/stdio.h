@@ -86,6 +86,9 @@ int printf(const char *fmt, ...);
 /*
  * formatted printing to a given buffer, printing at most len chars,
  * including the terminating character into dst.
+ *
+ * The string functions do not use the printf ring buffer: they can be
+ * called from ISR mode, and their output is not limited by its size.
  */
 int snprintf(char *dst, size_t len, const char *fmt, ...);
 
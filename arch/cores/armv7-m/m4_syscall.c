@@ -6,6 +6,10 @@
 /* Global variable holding the stack canary value */
 volatile uint32_t __stack_chk_guard = 0;
 
+/* Global variable holding the irq of the user ISR being executed (-1 in the main
+ * thread). The ISRs of a task are executed one at a time */
+volatile int32_t __current_isr = -1;
+
 /**
  ** \private
  */
@@ -49,6 +53,7 @@ void do_starttask(uint32_t slot, uint32_t seed)
 
     /* End of task */
     printf("\033[37;43mEnd of task\033[37;40m\n");
+    printf_flush();
     asm volatile ("svc %0\n"::"i" (SVC_EXIT):);
 
     while (1) {
@@ -63,6 +68,7 @@ void __stack_chk_fail(void)
 {
     /* We have failed to check our stack canary */
     printf("Failed to check the stack guard ! Stack corruption !");
+    printf_flush();
 
     /* End of task. NOTE: stack corruption is a serious security issue */
     asm volatile ("svc %0\n"::"i" (SVC_EXIT):);
@@ -90,7 +96,9 @@ void __stack_chk_fail(void)
 void do_startisr(handler_t handler, uint8_t irq, uint32_t status, uint32_t data)
 {
     if (handler) {
+        __current_isr = irq;
         handler(irq, status, data);
+        __current_isr = -1;
     }
 
     /* End of ISR */
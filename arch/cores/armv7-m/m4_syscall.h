@@ -9,4 +9,10 @@
 */
 e_syscall_ret do_syscall(e_svc_type svc,  __attribute__ ((unused)) struct gen_syscall_args * args);
 
+/**
+** \private
+** irq of the user ISR being executed, -1 in the main thread
+*/
+extern volatile int32_t __current_isr;
+
 #endif /*!SYSCALL_H_ */
@@ -30,4 +30,25 @@ bool core_semaphore_trylock(volatile uint32_t* semaphore);
 
 bool core_semaphore_release(volatile uint32_t* semaphore);
 
+/*
+ * Lock-free LIFO list: the head holds the address of the first element, the
+ * first word of each element holds the address of the next one (0 ends the list)
+ */
+void core_lifo_push(volatile uint32_t* head, void* elem);
+
+void* core_lifo_take(volatile uint32_t* head);
+
+/*
+ * Lock-free ring reservation: wr and rd are free running byte positions (the
+ * ring size must be a power of two). len bytes are reserved at wr if the ring
+ * has room for them, the former wr being returned (0xffffffff if no room)
+ */
+uint32_t core_ring_reserve(volatile uint32_t* wr, const volatile uint32_t* rd,
+                           uint32_t len, uint32_t size);
+
+/* Commit of reserved bytes: the word is stored once the bytes are visible */
+void core_ring_commit(volatile uint32_t* word, uint32_t value);
+
+void core_atomic_add(volatile uint32_t* value, uint32_t add);
+
 #endif
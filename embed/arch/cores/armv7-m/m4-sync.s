@@ -7,9 +7,19 @@
 .section .text
 .global core_semaphore_trylock
 .global core_semaphore_release
+.global core_lifo_push
+.global core_lifo_take
+.global core_ring_reserve
+.global core_ring_commit
+.global core_atomic_add
 
 .type  core_semaphore_trylock, %function
 .type  core_semaphore_release, %function
+.type  core_lifo_push, %function
+.type  core_lifo_take, %function
+.type  core_ring_reserve, %function
+.type  core_ring_commit, %function
+.type  core_atomic_add, %function
 
 core_semaphore_trylock:
     push    {r1,r2}
@@ -49,4 +59,85 @@ fail_core_semaphore_release:
     mov r0, #0
     bx lr
 
+
+core_lifo_push:
+    push    {r2,r3}
+retry_core_lifo_push:
+    ldr     r2, [r0]      /* Current head */
+    str     r2, [r1]      /* Linked to the new element (first word), out of */
+                          /* the exclusive section */
+    ldrex   r3, [r0]      /* Load-Exclusive of the head */
+    cmp     r3, r2        /* Check if the head is still the linked one */
+                          /* If not (pushed or taken meanwhile), retry */
+    bne     clear_core_lifo_push
+    strex   r3, r1, [r0]  /* Attempt Store-Exclusive of the new head */
+    cmp     r3, #0        /* Check if Store-Exclusive succeeded */
+                          /* If Store-Exclusive failed (preempted), retry */
+    bne     retry_core_lifo_push
+    dmb                   /* Element visible before any further access */
+    pop     {r2,r3}
+    bx lr
+clear_core_lifo_push:
+    clrex
+    b       retry_core_lifo_push
+
+
+core_lifo_take:
+    push    {r1,r2,r3}
+    mov     r3, #0
+retry_core_lifo_take:
+    ldrex   r1, [r0]      /* Load-Exclusive of the current head */
+    strex   r2, r3, [r0]  /* Attempt Store-Exclusive of an empty list */
+    cmp     r2, #0        /* Check if Store-Exclusive succeeded */
+                          /* If Store-Exclusive failed (preempted), retry */
+    bne     retry_core_lifo_take
+    dmb                   /* Required before accessing the taken elements */
+    mov     r0, r1        /* The whole former list is returned */
+    pop     {r1,r2,r3}
+    bx lr
+
+
+core_ring_reserve:
+    push    {r4,r5}
+retry_core_ring_reserve:
+    ldrex   r4, [r0]      /* Load-Exclusive of the write position */
+    ldr     r5, [r1]      /* Read position */
+    sub     r5, r4, r5    /* Used bytes */
+    add     r5, r2        /* Used bytes once reserved */
+    cmp     r5, r3        /* Check if the ring has room for len bytes */
+    bhi     fail_core_ring_reserve
+    add     r5, r4, r2    /* New write position */
+    strex   r12, r5, [r0] /* Attempt Store-Exclusive of the write position */
+    cmp     r12, #0       /* Check if Store-Exclusive succeeded */
+                          /* If Store-Exclusive failed (preempted), retry */
+    bne     retry_core_ring_reserve
+    dmb                   /* Required before writing the reserved bytes */
+    mov     r0, r4        /* The reserved bytes start at the former position */
+    pop     {r4,r5}
+    bx lr
+fail_core_ring_reserve:
+    clrex
+    mvn     r0, #0        /* No room: 0xffffffff is returned */
+    pop     {r4,r5}
+    bx lr
+
+
+core_ring_commit:
+    dmb                   /* Reserved bytes written before the commit word */
+    str     r1, [r0]
+    bx lr
+
+
+core_atomic_add:
+    push    {r2,r3}
+retry_core_atomic_add:
+    ldrex   r2, [r0]      /* Load-Exclusive of the current value */
+    add     r2, r1
+    strex   r3, r2, [r0]  /* Attempt Store-Exclusive of the new value */
+    cmp     r3, #0        /* Check if Store-Exclusive succeeded */
+                          /* If Store-Exclusive failed (preempted), retry */
+    bne     retry_core_atomic_add
+    pop     {r2,r3}
+    bx lr
+
 .end
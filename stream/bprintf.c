@@ -0,0 +1,247 @@
+/*
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * ur option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with this package; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ */
+#include "autoconf.h"
+
+#ifdef CONFIG_STD_PRINTF_DEFERRED
+
+#include "libc/nostd.h"
+#include "libc/stdarg.h"
+#include "libc/types.h"
+#include "libc/syscall.h"
+#include "libc/semaphore.h"
+
+
+/*
+ * Deferred binary logging.
+ *
+ * bprintf() does not format anything on the device: it records the
+ * address of its format string (a literal, placed by the bprintf()
+ * macro into the .bprintf_fmt section) and its raw arguments words
+ * into a local ring of words. The host side decoder
+ * (tools/bprintf_decode.py) gets the format strings back from the
+ * task ELF file and formats the records.
+ *
+ * A record is:
+ *    word 0        BPRINTF_MAGIC | number of arguments
+ *    word 1        format string address
+ *    word 2..      arguments, one word each
+ *
+ * Records are only written whole. When the ring has no room left,
+ * or when it is in use by another context (an ISR preempting the main
+ * thread while it records or reads), the new record is dropped and
+ * counted as lost: bprintf() never waits.
+ */
+
+#define BPRINTF_LEN         CONFIG_STD_PRINTF_DEFERRED_LEN
+#define BPRINTF_MAGIC       0xbf000000
+#define BPRINTF_MAGIC_MASK  0xffffff00
+
+/* room for the header and format words of a record */
+#define BPRINTF_HDR_WORDS   2
+
+/* log line prefix of the records sent by bprintf_flush() */
+#define BPRINTF_PREFIX      "BPF:"
+#define BPRINTF_PREFIX_LEN  4
+
+
+static uint32_t bprintf_ring[BPRINTF_LEN];
+
+static uint32_t bprintf_first;      /* index of the oldest record word */
+static uint32_t bprintf_nb;         /* number of used words */
+static uint32_t bprintf_lost;       /* number of dropped records */
+
+/*
+ * The ring is only used with a trylock: a context which finds it
+ * locked drops its record instead of waiting.
+ */
+static volatile uint32_t bprintf_lock = 1;
+
+
+/*
+ * Take the oldest record out of the ring (which must be locked) into
+ * rec, returning its number of words (0 if the ring is empty).
+ */
+static uint32_t bprintf_take(uint32_t *rec, const uint32_t max)
+{
+    uint32_t len;
+
+    if (!bprintf_nb) {
+        return 0;
+    }
+    len = BPRINTF_HDR_WORDS + (bprintf_ring[bprintf_first] & ~BPRINTF_MAGIC_MASK);
+    if (len > max) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < len; ++i) {
+        rec[i] = bprintf_ring[bprintf_first];
+        if (++bprintf_first == BPRINTF_LEN) {
+            bprintf_first = 0;
+        }
+    }
+    bprintf_nb -= len;
+    return len;
+}
+
+
+/*
+ * Recording of a bprintf() call (see the bprintf() macro)
+ */
+int _bprintf(const char *fmt, const uint32_t nargs, ...)
+{
+    va_list  args;
+    uint32_t end;
+
+    if (!fmt || (nargs > BPRINTF_MAX_ARGS)) {
+        return -1;
+    }
+    if (!mutex_trylock(&bprintf_lock)) {
+        ++bprintf_lost;
+        return -1;
+    }
+    if ((BPRINTF_LEN - bprintf_nb) < (BPRINTF_HDR_WORDS + nargs)) {
+        ++bprintf_lost;
+        mutex_unlock(&bprintf_lock);
+        return -1;
+    }
+
+    end = bprintf_first + bprintf_nb;
+    if (end >= BPRINTF_LEN) {
+        end -= BPRINTF_LEN;
+    }
+
+    bprintf_ring[end] = BPRINTF_MAGIC | nargs;
+    if (++end == BPRINTF_LEN) {
+        end = 0;
+    }
+    bprintf_ring[end] = (uint32_t) fmt;
+
+    va_start(args, nargs);
+    for (uint32_t i = 0; i < nargs; ++i) {
+        if (++end == BPRINTF_LEN) {
+            end = 0;
+        }
+        bprintf_ring[end] = va_arg(args, uint32_t);
+    }
+    va_end(args);
+
+    bprintf_nb += BPRINTF_HDR_WORDS + nargs;
+
+    mutex_unlock(&bprintf_lock);
+    return 0;
+}
+
+
+/*
+ * Send a record to the kernel log, hex encoded after the log prefix
+ */
+static void bprintf_log(const uint32_t *rec, const uint32_t len)
+{
+    /* prefix, then 8 hex chars per word */
+    char     line[BPRINTF_PREFIX_LEN + (8 * (BPRINTF_HDR_WORDS + BPRINTF_MAX_ARGS))];
+    uint32_t pos = 0;
+
+    for (; pos < BPRINTF_PREFIX_LEN; ++pos) {
+        line[pos] = BPRINTF_PREFIX[pos];
+    }
+    for (uint32_t w = 0; w < len; ++w) {
+        for (int8_t shift = 28; shift >= 0; shift -= 4) {
+            line[pos++] = "0123456789abcdef"[(rec[w] >> shift) & 0xf];
+        }
+    }
+    sys_log(pos, line);
+}
+
+
+/*
+ * Sending of the recorded calls to the kernel log, one record per log
+ * line. The records made during the flush are left for the next one.
+ */
+int bprintf_flush(void)
+{
+    uint32_t rec[BPRINTF_HDR_WORDS + BPRINTF_MAX_ARGS];
+    uint32_t len;
+    uint32_t todo;
+
+    if (!mutex_trylock(&bprintf_lock)) {
+        return -1;
+    }
+    todo = bprintf_nb;
+    rec[2] = bprintf_lost;
+    bprintf_lost = 0;
+    mutex_unlock(&bprintf_lock);
+
+    if (rec[2]) {
+        /* the lost records count is sent as a record with a null format */
+        rec[0] = BPRINTF_MAGIC | 1;
+        rec[1] = 0;
+        bprintf_log(rec, 3);
+    }
+
+    while (todo) {
+        if (!mutex_trylock(&bprintf_lock)) {
+            return -1;
+        }
+        len = bprintf_take(rec, BPRINTF_HDR_WORDS + BPRINTF_MAX_ARGS);
+        mutex_unlock(&bprintf_lock);
+
+        /* the ring is not locked during the syscall */
+        if (!len) {
+            break;
+        }
+        bprintf_log(rec, len);
+        todo = (len < todo) ? (todo - len) : 0;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Reading of the recorded calls (whole records only), for a task
+ * which sends them by its own means
+ */
+int bprintf_read(uint32_t *words, const uint32_t nb, uint32_t *nb_read,
+                 uint32_t *nb_lost)
+{
+    uint32_t len;
+
+    if (!words || !nb_read || !nb_lost) {
+        return -1;
+    }
+    if (!mutex_trylock(&bprintf_lock)) {
+        return -1;
+    }
+
+    *nb_read = 0;
+    while ((len = bprintf_take(&words[*nb_read], nb - *nb_read))) {
+        *nb_read += len;
+    }
+    *nb_lost = bprintf_lost;
+    bprintf_lost = 0;
+
+    mutex_unlock(&bprintf_lock);
+    return 0;
+}
+
+#endif
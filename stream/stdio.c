@@ -21,6 +21,7 @@
  * Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
  *
  */
+#include "autoconf.h"
 #include "libc/stdio.h"
 #include "libc/stdarg.h"
 #include "libc/nostd.h"
@@ -30,16 +31,24 @@
 #include "libc/semaphore.h"
 #include "string/string_priv.h"
 
+#ifdef CONFIG_ARCH_ARMV7M
+# include "arch/cores/armv7-m/m4-sync.h"
+#else
+# error "Unknown architecture"
+#endif
+
 
 /***********************************************
  * local utility functions
  **********************************************/
 
 /*
- * Stdio functions (*printf) use a local ring buffer
- * to hold formated content before sending it to the
- * kernel via the kernel log API (typically sys_log()
- * for EwoK).
+ * Stdio functions (printf() and vprintf()) use a local
+ * ring buffer to hold formated content before sending it
+ * to the kernel via the kernel log API (typically sys_log()
+ * for EwoK). The string functions (s[n]printf() familly)
+ * write straight into the caller's buffer instead, and
+ * aprintf() uses its own lock-free log ring (see below).
  * This ring buffer is holded in the libstd as a global
  * variable, local to this very file.
  * The ring buffer is initialized by the libstd at
@@ -57,12 +66,24 @@
  * Ring buffer and ring buffer utility functions
  */
 
-#define BUF_MAX 512
+/*
+ * The ring buffer holds the printf() and vprintf() output until it is
+ * sent to the kernel log. Its content always starts at buf[0]: it is
+ * sent from the start, the chars left in it (buffered mode) being moved
+ * back to the start.
+ *
+ * The kernel log API size is a logsize_t: the content is sent in chunks
+ * of at most LOG_CHUNK_MAX chars.
+ */
+#define BUF_MAX         CONFIG_STD_PRINTF_BUF_MAX
+#define LOG_CHUNK_MAX   255
+
+/* size from which the buffer content is sent by chunks (buffered mode) */
+#define LOG_FLUSH_MIN   ((BUF_MAX < LOG_CHUNK_MAX) ? BUF_MAX : LOG_CHUNK_MAX)
 
 struct s_ring {
-    uint32_t start;
-    uint32_t end;
-    bool     full;
+    uint32_t start;     /* start of the current printf() output */
+    uint32_t end;       /* number of chars in the buffer */
     char buf[BUF_MAX];
 };
 
@@ -85,10 +106,6 @@ static struct s_ring ring_buffer;
  * mutex on the ring_buffer, which ensure that the
  * ressource is released before executing the function
  * content.
- * ISR compatible functions (s[n]printf() and aprintf())
- * use a trylock mutex mechanism, which can fail, to avoid
- * any potential dead lock with the main thread as ISR are
- * executed with a higher priority.
  */
 static volatile uint32_t rb_lock = 1;
 
@@ -98,253 +115,422 @@ static volatile uint32_t rb_lock = 1;
  *
  * As a consequence, it has to be initialized at boot time.
  * This is done by this function, called by do_starttask().
+ * Only the indexes are set: the buffer content is never read
+ * beyond end.
  */
 void init_ring_buffer(void)
 {
-    /* init flags */
-    int     i = 0;
-
     ring_buffer.end = 0;
     ring_buffer.start = ring_buffer.end;
-    ring_buffer.full = false;
+}
 
-    /* memsetting buffer
-     * NOTE: This may be useless as, in EwoK, the BSS is zeroified
-     * at boot time.
-     */
-    for (i = 0; i < BUF_MAX; i++) {
-        ring_buffer.buf[i] = '\0';
+/*
+ * Send the ring buffer content to the kernel log, in chunks of at most
+ * LOG_CHUNK_MAX chars. A chunk holding a newline ends at its last one,
+ * so that the log lines are not split between two sys_log() calls.
+ *
+ * Unless all is set, the content is only sent while at least
+ * LOG_FLUSH_MIN chars are left, the remaining chars being kept in the
+ * buffer for the next flush (buffered mode).
+ */
+static void ring_buffer_flush(bool all)
+{
+    uint32_t pos = 0;
+    uint32_t len;
+    uint32_t i;
+
+    while ((ring_buffer.end - pos) >= (all ? 1 : LOG_FLUSH_MIN)) {
+        len = ring_buffer.end - pos;
+        if (len > LOG_CHUNK_MAX) {
+            len = LOG_CHUNK_MAX;
+            for (i = len; i > 0; --i) {
+                if (ring_buffer.buf[pos + i - 1] == '\n') {
+                    len = i;
+                    break;
+                }
+            }
+        }
+        sys_log((logsize_t) len, &(ring_buffer.buf[pos]));
+        pos += len;
+    }
+
+    /* moving the remaining chars (less than a chunk) to the start */
+    for (i = pos; i < ring_buffer.end; ++i) {
+        ring_buffer.buf[i - pos] = ring_buffer.buf[i];
     }
+    ring_buffer.end -= pos;
+    ring_buffer.start = (ring_buffer.start > pos) ? (ring_buffer.start - pos) : 0;
 }
 
 /*
  * add a char in the ring buffer.
  *
- * INFO: by now, there is no bound check here. As a consequence, if
- * the ring buffer is full,
- *
- * WARNING: this function is the only one holding the ring buffer full
- * flag detection. As a consequence, any write access to the ring buffer
- * must be done through this function *exclusively*.
+ * When the ring buffer is full, its content is sent to the kernel log
+ * to make room: the printf() output is not limited by BUF_MAX.
  */
 static inline void ring_buffer_write_char(const char c)
 {
-    /* if the ring buffer is full when we try to put char in it,
-     * the car is discared, waiting for the ring buffer to be flushed.
-     */
-    if (ring_buffer.full) {
-        goto end;
-    }
-    ring_buffer.buf[ring_buffer.end] = c;
-    if (((ring_buffer.end + 1) % BUF_MAX) != ring_buffer.start) {
-        ring_buffer.end++;
-        ring_buffer.end %= BUF_MAX;
-    } else {
-        /* full buffer detection */
-        ring_buffer.full = true;
+    if (ring_buffer.end == BUF_MAX) {
+        ring_buffer_flush(false);
     }
- end:
-    return;
+    ring_buffer.buf[ring_buffer.end++] = c;
 }
 
 /*
- * Write a digit to the ring buffer.
- * This function convert a basic digit into a printable one.
- *
- * This function support usual bases such as binary
- *
- * INFO: this function can write digits in base up to hexadecimal one.
- * Bases bigger than hex are not supported.
- *
+ * Start of a printf() output in the ring buffer
  */
-static inline void ring_buffer_write_digit(uint8_t digit)
+static inline void ring_buffer_begin(void)
 {
-    if (digit < 0xa) {
-        digit += '0';
-        ring_buffer_write_char(digit);
-    } else if (digit <= 0xf) {
-        digit += 'a' - 0xa;
-        ring_buffer_write_char(digit);
-    }
+    ring_buffer.start = ring_buffer.end;
 }
 
 /*
- * copy a string to the ring buffer. This is an abstraction of the
- * ring_buffer_write_char() function.
+ * Drop the current printf() output, on error (the chars already sent
+ * because of a full buffer can't be dropped). The previous buffered
+ * content is kept.
+ */
+static inline void ring_buffer_cancel(void)
+{
+    ring_buffer.end = ring_buffer.start;
+}
+
+/*
+ * End of a printf() output: the ring buffer content is sent to the
+ * kernel log API. In buffered mode, only full chunks are sent, the
+ * output of several calls being gathered into each sys_log() call.
+ */
+static inline void ring_buffer_commit(void)
+{
+#ifdef CONFIG_STD_PRINTF_BUFFERED
+    ring_buffer_flush(false);
+#else
+    ring_buffer_flush(true);
+#endif
+}
+
+
+/*********************************************
+ * Asynchronous log ring (aprintf())
+ */
+
+/*
+ * aprintf() formats its message on its own stack, then copies it as
+ * a record into the log ring, without any lock:
+ *    * the record room is reserved by moving the free running write
+ *      position with LDREX/STREX (core_ring_reserve()): concurrent
+ *      producers (the main thread and the ISRs preempting it) get
+ *      distinct rooms, and write them concurrently
+ *    * the record header word (committed flag and length) is stored
+ *      last (core_ring_commit()), once the message is written
+ *    * the consumer (aprintf_flush(), main thread) sends the committed
+ *      records in order, and stops at the first one still being
+ *      written (its producer has been preempted)
  *
- * This function is a helper function above ring_buffer_write_char().
+ * A record is a header word followed by the message, its size being
+ * rounded up to a word so that headers are never split by the ring
+ * end. When the ring has no room for a record, it is dropped and
+ * counted (see aprintf_stats()).
+ */
+
+#define ALOG_SIZE           CONFIG_STD_APRINTF_RING_SIZE
+
+#if (ALOG_SIZE & (ALOG_SIZE - 1)) || (ALOG_SIZE < 64)
+# error "aprintf() ring size must be a power of two of at least 64 bytes"
+#endif
+
+/* a record is sent by one sys_log() call (logsize_t length), and
+ * must fit into the ring: a ring smaller than 259 bytes truncates
+ * the messages to its size minus the header word */
+#if ALOG_SIZE - 4 < 255
+# define ALOG_LINE_MAX      (ALOG_SIZE - 4)
+#else
+# define ALOG_LINE_MAX      255
+#endif
+
+#define ALOG_COMMITTED      0x80000000
+#define ALOG_NO_ROOM        0xffffffff
+#define ALOG_REC_SZ(len)    (4 + (((len) + 3) & ~3))
+#define ALOG_POS(pos)       ((pos) & (ALOG_SIZE - 1))
+
+static struct {
+    volatile uint32_t wr;           /* reserved bytes (free running) */
+    volatile uint32_t rd;           /* consumed bytes (free running) */
+    uint8_t  buf[ALOG_SIZE] __attribute__((aligned(4)));
+} alog;
+
+static volatile struct aprintf_stats alog_stats;
+
+/*
+ * The consumer side only is locked (aprintf_flush() and printf()
+ * may not be executed concurrently).
+ */
+static volatile uint32_t alog_lock = 1;
+
+
+/*
+ * Copy len bytes from/to the ring at the given position, handling the
+ * ring end.
  */
-static inline void ring_buffer_write_string(char *str, uint32_t len)
+static void alog_copy_in(uint32_t pos, const char *src, uint32_t len)
 {
-    if (!str) {
-        goto end;
+    for (uint32_t i = 0; i < len; ++i) {
+        alog.buf[ALOG_POS(pos + i)] = src[i];
     }
-    for (uint32_t i = 0; (i < len) && (str[i]); ++i) {
-        ring_buffer_write_char(str[i]);
+}
+
+static void alog_copy_out(char *dst, uint32_t pos, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i) {
+        dst[i] = alog.buf[ALOG_POS(pos + i)];
     }
- end:
-    return;
 }
 
 /*
- * Write a number in the ring buffer.
- * This function is a helper function above ring_buffer_write_char().
+ * Send the committed records to the kernel log, concatenated up to
+ * ALOG_LINE_MAX chars per sys_log() call.
  */
-static void ring_buffer_write_number(uint64_t value, uint8_t base)
+static int alog_drain(void)
 {
-    /* we define a local storage to hold the digits list
-     * in any possible base up to base 2 (64 bits) */
-    uint8_t number[64] = { 0 };
-    int     index = 0;
+    char     line[ALOG_LINE_MAX];
+    uint32_t used = 0;
+    uint32_t hdr;
+    uint32_t len;
+    uint32_t pos;
+
+    if (!mutex_trylock(&alog_lock)) {
+        /* another context is draining the ring */
+        return -1;
+    }
 
-    for (; (value / base) != 0; value /= base) {
-        number[index++] = value % base;
+    /* the ring only fills up between two drains */
+    if ((alog.wr - alog.rd) > alog_stats.max_used_sz) {
+        alog_stats.max_used_sz = alog.wr - alog.rd;
     }
-    /* finishing with most significant unit */
-    number[index++] = value % base;
 
-    /* Due to the last 'index++', index is targetting the first free cell.
-     * We make it points the last *used* cell instead */
-    index--;
+    while (alog.rd != alog.wr) {
+        pos = alog.rd;
+        hdr = *(volatile uint32_t *) &alog.buf[ALOG_POS(pos)];
+        if (!(hdr & ALOG_COMMITTED)) {
+            /* still being written by a preempted producer */
+            break;
+        }
+        len = hdr & ~ALOG_COMMITTED;
+
+        if ((used + len) > ALOG_LINE_MAX) {
+            sys_log(used, line);
+            used = 0;
+        }
+        alog_copy_out(&line[used], pos + 4, len);
+        used += len;
 
-    /* now we can print out, starting with the most significant unit */
-    for (; index >= 0; index--) {
-        ring_buffer_write_digit(number[index]);
+        /* the record words are cleared, so that a header word reserved
+         * later at any of their positions reads as not committed */
+        for (uint32_t i = 0; i < ALOG_REC_SZ(len); i += 4) {
+            *(volatile uint32_t *) &alog.buf[ALOG_POS(pos + i)] = 0;
+        }
+        alog.rd = pos + ALOG_REC_SZ(len);
+    }
+    if (used) {
+        sys_log(used, line);
     }
-}
 
+    mutex_unlock(&alog_lock);
+    return 0;
+}
 
-static void ring_buffer_reset(void)
-{
-    ring_buffer.end = 0;
-    ring_buffer.start = ring_buffer.end;
-    ring_buffer.full = false;
 
-    memset(ring_buffer.buf, 0x0, BUF_MAX);
-}
+/*********************************************
+ * Output sink and output sink utility functions
+ */
 
+/*
+ * The formatter writes its output into a sink, which is either
+ * the ring buffer (printf() familly, the ring buffer being locked
+ * by the caller), or the caller's string (s[n]printf() familly).
+ *
+ * A string sink is local to the calling function: the string
+ * functions do not touch the ring buffer nor its mutex. They are
+ * reentrant (and can be used in ISR mode while the main thread is
+ * printing), and the output is written once, straight into dst.
+ */
+typedef struct {
+    char    *dst;       /* destination string, NULL for the ring buffer */
+    uint32_t size;      /* dst size, including the terminating byte */
+    uint32_t len;       /* number of chars produced by the formatter */
+} print_sink_t;
 
 /*
- * Print the ring buffer content (if there is some), and reset its
- * state to empty state.
- * The ring buffer is also memset'ed to 0.
+ * add a char to the sink.
  *
- * The buffer content is sent to the kernel log API.
+ * For a string sink, the chars that do not fit into dst (keeping
+ * room for the terminating byte) are counted but discarded.
  */
-static void print_and_reset_buffer(void)
+static inline void sink_write_char(print_sink_t *sink, const char c)
 {
-
-    /* there is two cases here:
-     *    * end is after start in the ring buffer. This means that
-     *      all the string chars are contigous and can be printed once
-     *    * start is after end, the string must be printed in two
-     *      sections
-     */
-    if (ring_buffer.end > ring_buffer.start) {
-        sys_log(ring_buffer.end - ring_buffer.start,
-                &(ring_buffer.buf[ring_buffer.start]));
-    } else if (ring_buffer.end < ring_buffer.start) {
-        sys_log(BUF_MAX - ring_buffer.start,
-                &(ring_buffer.buf[ring_buffer.start]));
-        sys_log(ring_buffer.end, &(ring_buffer.buf[0]));
+    if (!sink->dst) {
+        ring_buffer_write_char(c);
+    } else if (sink->len + 1 < sink->size) {
+        sink->dst[sink->len] = c;
     }
-    /* reset the ring buffer flags now that the content has been
-     * sent to the kernel I/O API
-     */
-    ring_buffer_reset();
-
-    return;
+    sink->len++;
 }
 
 /*
- * Rewind the ring buffer of the given len. This function remove
- * len chars (at most) from the ring buffer and return the effectively
- * removed number of chars, depending on the current ring buffer state
+ * copy a string to the sink. This is an abstraction of the
+ * sink_write_char() function.
+ *
+ * This function is a helper function above sink_write_char().
  */
-static uint32_t ring_buffer_rewind(uint32_t len)
+static inline void sink_write_string(print_sink_t *sink, char *str, uint32_t len)
 {
-    /* sanitizing len */
-    if (len >= BUF_MAX) {
-        return 0;
+    if (!str) {
+        goto end;
     }
-    if (ring_buffer.end > ring_buffer.start) {
-        if (len > (ring_buffer.end - ring_buffer.start)) {
-            return 0;
-        }
-    } else if (ring_buffer.start > ring_buffer.end) {
-        if (len > ((BUF_MAX - ring_buffer.start) + (ring_buffer.end))) {
-            return 0;
-        }
+    for (uint32_t i = 0; (i < len) && (str[i]); ++i) {
+        sink_write_char(sink, str[i]);
     }
+ end:
+    return;
+}
 
-    if (ring_buffer.end >= len) {
-        for (uint16_t i = (ring_buffer.end - len); i < ring_buffer.end; i++) {
-            ring_buffer.buf[i] = '\0';
-        }
-        ring_buffer.end -= len;
+/*
+ * Digits pairs, from "00" to "99", for the decimal conversion
+ */
+static const char dec_pairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+/*
+ * Convert a 32 bits value in decimal, writing the digits backward from
+ * end. Two digits are produced per division by 100, which the compiler
+ * turns into a multiplication by its reciprocal (no division call).
+ *
+ * Return the first digit address.
+ */
+static inline char *number_to_dec32(char *end, uint32_t value)
+{
+    uint32_t q;
+    uint32_t r;
+
+    while (value >= 100) {
+        q = value / 100;
+        r = (value - (q * 100)) * 2;
+        end -= 2;
+        end[0] = dec_pairs[r];
+        end[1] = dec_pairs[r + 1];
+        value = q;
+    }
+    if (value >= 10) {
+        end -= 2;
+        end[0] = dec_pairs[value * 2];
+        end[1] = dec_pairs[(value * 2) + 1];
     } else {
-        uint32_t first = ring_buffer.end;
+        *--end = (char) ('0' + value);
+    }
+    return end;
+}
 
-        for (uint16_t i = 0; i < ring_buffer.end; i++) {
-            ring_buffer.buf[i] = '\0';
-        }
-        for (uint16_t i = (BUF_MAX - len + first); i < BUF_MAX; i++) {
-            ring_buffer.buf[i] = '\0';
+/*
+ * Convert a value in the given base (2, 8, 10 or 16), writing the digits
+ * backward from end.
+ *
+ * The power of two bases only need shifts and masks. In decimal, only
+ * the values which do not fit in 32 bits need a 64 bits division (which
+ * is a libgcc call on Cortex-M), once per 9 digits.
+ *
+ * Return the first digit address.
+ */
+static char *number_to_ascii(char *end, uint64_t value, uint8_t base)
+{
+    uint64_t q;
+    char    *start;
+    uint8_t  shift;
+
+    if (base == 10) {
+        while (value > 0xffffffff) {
+            q = value / 1000000000;
+            start = number_to_dec32(end, (uint32_t) (value - (q * 1000000000)));
+            /* the 9 low digits are zero-padded */
+            while (start > (end - 9)) {
+                *--start = '0';
+            }
+            end = start;
+            value = q;
         }
-        ring_buffer.end = BUF_MAX - len + first;
+        return number_to_dec32(end, (uint32_t) value);
     }
-    return len;
+
+    shift = (base == 16) ? 4 : ((base == 8) ? 3 : 1);
+    do {
+        *--end = hex_digits[value & (base - 1)];
+        value >>= shift;
+    } while (value);
+    return end;
 }
 
 /*
- * Here we 'rewind' the ring buffer, as we use it as a tmp buffer without knowning
- * if there is other data that need to be printed in it. As a consequence, we can't
- * use the ring_buffer.start field.
+ * Write a number to the sink, zero-padded up to pad digits.
+ * This function is a helper function above sink_write_char().
  */
-static uint32_t ring_buffer_export(char *dst, uint32_t len)
+static void sink_write_number(print_sink_t *sink, uint64_t value, uint8_t base,
+                              uint8_t pad)
 {
-    if (len >= BUF_MAX || !dst) {
-        return 0;
+    /* we define a local storage to hold the digits list
+     * in any possible base up to base 2 (64 bits) */
+    char     number[64];
+    char    *digit = number_to_ascii(&number[64], value, base);
+    uint32_t len = (uint32_t) (&number[64] - digit);
+
+    /* we have to pad with 0 the number to reach the desired size */
+    for (uint32_t i = len; i < pad; ++i) {
+        sink_write_char(sink, '0');
     }
-    if (ring_buffer.end >= len) {
-        memcpy(dst, &(ring_buffer.buf[ring_buffer.end - len]), len);
-        memset(&(ring_buffer.buf[ring_buffer.end - len]), 0x0, len);
-        ring_buffer.end -= len;
-    } else {
-        uint32_t last_chunk = ring_buffer.end;
-        uint32_t first_chunk = BUF_MAX - len + last_chunk;
-
-        memcpy(dst, &(ring_buffer.buf[first_chunk]), len - last_chunk);
-        memset(&(ring_buffer.buf[first_chunk]), 0x0, len - last_chunk);
-        memcpy(&(dst[len - last_chunk]), ring_buffer.buf, last_chunk);
-        memset(ring_buffer.buf, 0x0, last_chunk);
-        ring_buffer.end = first_chunk;
+    for (; digit < &number[64]; ++digit) {
+        sink_write_char(sink, *digit);
     }
-    dst[len] = '\0';
-    return len;
 }
 
-
-/*********************************************
- * other, not ring-buffer associated local utility functions
+/*
+ * Write a signed decimal number to the sink, the '-' sign being part
+ * of the padded size.
  */
+static void sink_write_signed(print_sink_t *sink, long long value, uint8_t pad)
+{
+    if (value < 0) {
+        sink_write_char(sink, '-');
+        sink_write_number(sink, (uint64_t) 0 - (uint64_t) value, 10,
+                          pad ? pad - 1 : 0);
+    } else {
+        sink_write_number(sink, (uint64_t) value, 10, pad);
+    }
+}
 
 /*
- * Return the number of digits of the given number, considering
- * the base in which the number is encoded.
+ * Terminate the string of a string sink, and return the number of
+ * chars written into it (the terminating byte excluded).
  */
-static uint8_t get_number_len(uint64_t value, uint8_t base)
+static uint32_t sink_terminate(print_sink_t *sink)
 {
-    /* at least, if value is 0, its lenght is 1 digit */
-    uint8_t len = 1;
+    uint32_t written = sink->len;
 
-    /* now we calculate the number of digits in the number */
-    for (; (value / base) != 0; value /= base) {
-        len++;
+    if (!sink->size) {
+        /* no room, even for the terminating byte */
+        return 0;
     }
-    return len;
+    if (written >= sink->size) {
+        /* POSIX specify that size includes the terminating byte */
+        written = sink->size - 1;
+    }
+    sink->dst[written] = '\0';
+    return written;
 }
 
+
 /**************************************************
  * printf lexer implementation
  *************************************************/
@@ -366,9 +552,16 @@ typedef struct {
     fs_num_mode_t numeric_mode;
     bool    started;
     uint8_t consumed;
-    uint32_t strlen;
 } fs_properties_t;
 
+/*
+ * Size to which a numerical value is zero-padded (0 if no padding)
+ */
+static inline uint8_t fs_pad(const fs_properties_t *fs_prop)
+{
+    return (fs_prop->attr_size && fs_prop->attr_0len) ? fs_prop->size : 0;
+}
+
 
 /*
  * Handle one format string (starting with '%' char).
@@ -380,9 +573,9 @@ typedef struct {
  * by the format string itself, and return 0 if the format string has been
  * correctly parsed, or 1 if the format string parsing failed.
  */
-static uint8_t print_handle_format_string(const char *fmt, va_list * args,
-                                          uint8_t * consumed,
-                                          uint32_t * out_str_len)
+static uint8_t print_handle_format_string(print_sink_t *sink,
+                                          const char *fmt, va_list * args,
+                                          uint8_t * consumed)
 {
     fs_properties_t fs_prop = {
         .attr_0len = false,
@@ -390,14 +583,13 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
         .size = 0,
         .numeric_mode = FS_NUM_DECIMAL, /*default */
         .started = false,
-        .consumed = 0,
-        .strlen = 0
+        .consumed = 0
     };
 
     /*
      * Sanitation
      */
-    if (!fmt || !args || !consumed) {
+    if (!sink || !fmt || !args || !consumed) {
         return 1;
     }
 
@@ -414,8 +606,7 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                         fs_prop.started = true;
                     } else if (fs_prop.consumed == 1) {
                         /* detecting '%' just after '%' */
-                        ring_buffer_write_char('%');
-                        fs_prop.strlen++;
+                        sink_write_char(sink, '%');
                         /* => end of format string */
                         goto end;
                     } else {
@@ -462,19 +653,9 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                     }
                     fs_prop.numeric_mode = FS_NUM_DECIMAL;
                     int     val = va_arg(*args, int);
-                    uint8_t len = get_number_len(val, 10);
 
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            ring_buffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
                     /* now we can print the number in argument */
-                    ring_buffer_write_number(val, 10);
-                    fs_prop.strlen += len;
+                    sink_write_signed(sink, val, fs_pad(&fs_prop));
                     /* => end of format string */
                     goto end;
                 }
@@ -485,7 +666,6 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                      */
                     long    lval;
                     long long llval;
-                    uint8_t len;
 
                     if (fs_prop.started == false) {
                         goto err;
@@ -498,28 +678,15 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                     }
                     if (fs_prop.numeric_mode == FS_NUM_LONG) {
                         lval = va_arg(*args, long);
-
-                        len = get_number_len(lval, 10);
                     } else {
                         llval = va_arg(*args, long long);
-
-                        len = get_number_len(llval, 10);
-                    }
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            ring_buffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
                     }
                     /* now we can print the number in argument */
                     if (fs_prop.numeric_mode == FS_NUM_LONG) {
-                        ring_buffer_write_number(lval, 10);
+                        sink_write_signed(sink, lval, fs_pad(&fs_prop));
                     } else {
-                        ring_buffer_write_number(llval, 10);
+                        sink_write_signed(sink, llval, fs_pad(&fs_prop));
                     }
-                    fs_prop.strlen += len;
                     /* => end of format string */
                     goto end;
                 }
@@ -530,7 +697,6 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                      */
                     short   s_val;
                     unsigned char uc_val;
-                    uint8_t len;
 
                     if (fs_prop.started == false) {
                         goto err;
@@ -543,28 +709,15 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                     }
                     if (fs_prop.numeric_mode == FS_NUM_SHORT) {
                         s_val = (short) va_arg(*args, int);
-
-                        len = get_number_len(s_val, 10);
                     } else {
                         uc_val = (unsigned char) va_arg(*args, int);
-
-                        len = get_number_len(uc_val, 10);
-                    }
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            ring_buffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
                     }
                     /* now we can print the number in argument */
                     if (fs_prop.numeric_mode == FS_NUM_SHORT) {
-                        ring_buffer_write_number(s_val, 10);
+                        sink_write_signed(sink, s_val, fs_pad(&fs_prop));
                     } else {
-                        ring_buffer_write_number(uc_val, 10);
+                        sink_write_number(sink, uc_val, 10, fs_pad(&fs_prop));
                     }
-                    fs_prop.strlen += len;
                     /* => end of format string */
                     goto end;
                 }
@@ -578,19 +731,9 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                     }
                     fs_prop.numeric_mode = FS_NUM_UNSIGNED;
                     uint32_t val = va_arg(*args, uint32_t);
-                    uint8_t len = get_number_len(val, 10);
 
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            ring_buffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
                     /* now we can print the number in argument */
-                    ring_buffer_write_number(val, 10);
-                    fs_prop.strlen += len;
+                    sink_write_number(sink, val, 10, fs_pad(&fs_prop));
                     /* => end of format string */
                     goto end;
                 }
@@ -604,16 +747,10 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                         goto err;
                     }
                     uint32_t val = va_arg(*args, physaddr_t);
-                    uint8_t len = get_number_len(val, 16);
 
-                    ring_buffer_write_string("0x", 2);
-                    for (uint32_t i = len; i < fs_prop.size; ++i) {
-                        ring_buffer_write_char('0');
-                        fs_prop.strlen++;
-                    }
+                    sink_write_string(sink, "0x", 2);
                     /* now we can print the number in argument */
-                    ring_buffer_write_number(val, 16);
-                    fs_prop.strlen += len;
+                    sink_write_number(sink, val, 16, fs_prop.size);
                     /* => end of format string */
                     goto end;
                 }
@@ -628,19 +765,9 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                     }
                     fs_prop.numeric_mode = FS_NUM_UNSIGNED;
                     uint32_t val = va_arg(*args, uint32_t);
-                    uint8_t len = get_number_len(val, 16);
 
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            ring_buffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
                     /* now we can print the number in argument */
-                    ring_buffer_write_number(val, 16);
-                    fs_prop.strlen += len;
+                    sink_write_number(sink, val, 16, fs_pad(&fs_prop));
                     /* => end of format string */
                     goto end;
                 }
@@ -654,19 +781,9 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                     }
                     fs_prop.numeric_mode = FS_NUM_UNSIGNED;
                     uint32_t val = va_arg(*args, uint32_t);
-                    uint8_t len = get_number_len(val, 8);
 
-                    if (fs_prop.attr_size && fs_prop.attr_0len) {
-                        /* we have to pad with 0 the number to reach
-                         * the desired size */
-                        for (uint32_t i = len; i < fs_prop.size; ++i) {
-                            ring_buffer_write_char('0');
-                            fs_prop.strlen++;
-                        }
-                    }
                     /* now we can print the number in argument */
-                    ring_buffer_write_number(val, 8);
-                    fs_prop.strlen += len;
+                    sink_write_number(sink, val, 8, fs_pad(&fs_prop));
 
                     /* => end of format string */
                     goto end;
@@ -686,8 +803,7 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                     char   *str = va_arg(*args, char *);
 
                     /* now we can print the number in argument */
-                    ring_buffer_write_string(str, strlen(str));
-                    fs_prop.strlen += strlen(str);
+                    sink_write_string(sink, str, strlen(str));
 
                     /* => end of format string */
                     goto end;
@@ -707,7 +823,7 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
                     unsigned char val = (unsigned char) va_arg(*args, int);
 
                     /* now we can print the number in argument */
-                    ring_buffer_write_char(val);
+                    sink_write_char(sink, val);
 
                     /* => end of format string */
                     goto end;
@@ -725,47 +841,55 @@ static uint8_t print_handle_format_string(const char *fmt, va_list * args,
         fs_prop.consumed++;
     } while (fmt[fs_prop.consumed]);
  end:
-    *out_str_len += fs_prop.strlen;
     *consumed = fs_prop.consumed + 1;   /* consumed is starting with 0 */
     return 0;
  err:
-    *out_str_len += fs_prop.strlen;
     *consumed = fs_prop.consumed + 1;   /* consumed is starting with 0 */
     return 1;
 }
 
 
 /*
- * Print a given fmt string, considering variable arguments given in args.
- * This function *does not* flush the ring buffer, but only fullfill it.
+ * Print a given fmt string into the given sink, considering variable
+ * arguments given in args.
  */
-int print(const char *fmt, va_list args, size_t *sizew)
+static int print_to_sink(print_sink_t *sink, const char *fmt, va_list args)
 {
     int     i = 0;
     uint8_t consumed = 0;
-    uint32_t out_str_s = 0;
 
     while (fmt[i]) {
         if (fmt[i] == '%') {
             if (print_handle_format_string
-                (&(fmt[i]), &args, &consumed, &out_str_s)) {
+                (sink, &(fmt[i]), &args, &consumed)) {
                 /* the string format parsing has failed ! */
                 goto err;
             }
             i += consumed;
             consumed = 0;
         } else {
-            out_str_s++;
-            ring_buffer_write_char(fmt[i++]);
+            sink_write_char(sink, fmt[i++]);
         }
     }
-    *sizew = out_str_s;
     return 0;
  err:
-    *sizew = out_str_s;
     return -1;
 }
 
+/*
+ * Print a given fmt string, considering variable arguments given in args.
+ * This function *does not* flush the ring buffer, but only fullfill it.
+ */
+int print(const char *fmt, va_list args, size_t *sizew)
+{
+    print_sink_t sink = { .dst = NULL, .size = 0, .len = 0 };
+    int     res;
+
+    res = print_to_sink(&sink, fmt, args);
+    *sizew = sink.len;
+    return res;
+}
+
 
 /*************************************************************
  * libstream exported API implementation: POSIX compilant API
@@ -787,18 +911,23 @@ int printf(const char *fmt, ...)
     }
     /*
      * if there is some asyncrhonous printf to pass to the kernel, do it
-     * before execute the current printf command
+     * before execute the current printf command (after the buffered
+     * output of the previous ones)
      */
-    print_and_reset_buffer();
+    if (alog.rd != alog.wr) {
+        ring_buffer_flush(true);
+        alog_drain();
+    }
+    ring_buffer_begin();
     va_start(args, fmt);
     res = print(fmt, args, &len);
     va_end(args);
     if (res == -1) {
-        ring_buffer_reset();
+        ring_buffer_cancel();
         goto err;
     }
 
-    print_and_reset_buffer();
+    ring_buffer_commit();
  err:
     /* unlocking the ring buffer */
     mutex_unlock(&rb_lock);
@@ -806,100 +935,30 @@ int printf(const char *fmt, ...)
     return res;
 }
 
+/*
+ * The string functions below format straight into dst, without using
+ * the ring buffer (see print_sink_t): they never fail because another
+ * context is printing.
+ */
 int snprintf(char *dst, size_t len, const char *fmt, ...)
 {
     va_list args;
-    size_t  sizew = 0;
-    size_t  to_copy;
     int     res = -1;
 
-    /* sanitize */
-    if (!dst) {
-        goto err_init;
-    }
-    if (!mutex_trylock(&rb_lock)) {
-        /* unable to lock the ring buffer, another context is currently
-         * using it. As we may be executed in ISR mode, we prefer to
-         * give up instead of waiting for the buffer to be released */
-        goto err_init;
-    }
     va_start(args, fmt);
-    res = print(fmt, args, &sizew);
+    res = vsnprintf(dst, len, fmt, args);
     va_end(args);
-    /* if print fails, returns -1 */
-    if (res == -1) {
-        ring_buffer_rewind(sizew);
-        goto err;
-    }
-    /* copy the string we have just written to the ring buffer
-     * into the dst string
-     */
-    if (sizew >= len) {
-        /* POSIX specify that len includes the terminating byte */
-        to_copy = len - 1;
-        /* if there is more in the buffer that dst can hold, the
-         * string must be trunkated in the ring buffer first */
-        ring_buffer_rewind(sizew - len);
-    } else {
-        to_copy = sizew;
-    }
-    /* export and rewind ring buffer content we have just written */
-    ring_buffer_export(dst, to_copy);
-    dst[to_copy] = '\0';
-    /* unlocking the ring buffer */
-    mutex_unlock(&rb_lock);
-    /* returning the number of written chars, casted to int
-     * as defined by POSIX standard, to support negative return
-     * on error.
-     * We consider here that size_t is smaller enough to
-     * be casted into int without being truncated
-     */
-    return (int) to_copy;
- err:
-    mutex_unlock(&rb_lock);
- err_init:
     return res;
 }
 
 int sprintf(char *dst, const char *fmt, ...)
 {
     va_list args;
-    size_t  sizew = 0;
     int     res = -1;
 
-    /* sanitize */
-    if (!dst) {
-        goto err_init;
-    }
-    if (!mutex_trylock(&rb_lock)) {
-        /* unable to lock the ring buffer, another context is currently
-         * using it. As we may be executed in ISR mode, we prefer to
-         * give up instead of waiting for the buffer to be released */
-        goto err_init;
-    }
     va_start(args, fmt);
-    res = print(fmt, args, &sizew);
+    res = vsprintf(dst, fmt, args);
     va_end(args);
-    /* if print fails, returns -1 */
-    if (res == -1) {
-        ring_buffer_rewind(sizew);
-        goto err;
-    }
-    /* export and rewind ring buffer content we have just written */
-    ring_buffer_export(dst, sizew);
-    dst[sizew] = '\0';
-    /* unlocking the ring buffer */
-    mutex_unlock(&rb_lock);
-    /* returning the number of written chars, casted to int
-     * as defined by POSIX standard, to support negative return
-     * on error.
-     * We consider here that size_t is smaller enough to
-     * be casted into int without being truncated
-     */
-    return (int) sizew;
- err:
-    mutex_unlock(&rb_lock);
- err_init:
     return res;
 }
 
@@ -923,16 +982,21 @@ int vprintf(const char *fmt, va_list args)
     }
     /*
      * if there is some asyncrhonous printf to pass to the kernel, do it
-     * before execute the current printf command
+     * before execute the current printf command (after the buffered
+     * output of the previous ones)
      */
-    print_and_reset_buffer();
+    if (alog.rd != alog.wr) {
+        ring_buffer_flush(true);
+        alog_drain();
+    }
+    ring_buffer_begin();
     res = print(fmt, args, &len);
     /* unlocking the ring buffer */
     if (res == -1) {
-        ring_buffer_rewind(len);
+        ring_buffer_cancel();
         goto err;
     }
-    print_and_reset_buffer();
+    ring_buffer_commit();
  err:
     mutex_unlock(&rb_lock);
  err_init:
@@ -942,93 +1006,33 @@ int vprintf(const char *fmt, va_list args)
 
 int vsnprintf(char *dst, size_t len, const char *fmt, va_list args)
 {
-    size_t  sizew = 0;
-    size_t  to_copy;
-    int     ret = -1;
+    print_sink_t sink = { .dst = dst, .size = (uint32_t) len, .len = 0 };
+    uint32_t written;
 
     /* sanitize */
     if (!dst || !fmt) {
-        goto err_init;
-    }
-    if (!mutex_trylock(&rb_lock)) {
-        /* unable to lock the ring buffer, another context is currently
-         * using it. As we may be executed in ISR mode, we prefer to
-         * give up instead of waiting for the buffer to be released */
-        goto err_init;
-    }
-    ret = print(fmt, args, &sizew);
-    /* copy the string we have just written to the ring buffer
-     * into the dst string
-     */
-    if (ret == -1) {
-        ring_buffer_rewind(sizew);
-        goto err;
+        return -1;
     }
-    if (sizew >= len) {
-        /* POSIX specify that len includes the terminating byte */
-        to_copy = len - 1;
-        /* we trunkate the input string to the correct size */
-        ring_buffer_rewind(sizew - len);
-    } else {
-        to_copy = sizew;
+    if (print_to_sink(&sink, fmt, args) == -1) {
+        /* the partial content is terminated, but not returned */
+        sink_terminate(&sink);
+        return -1;
     }
-    /* rewind ring buffer content we have just written */
-    ring_buffer_export(dst, to_copy);
-    dst[to_copy] = '\0';
-    /* unlocking the ring buffer */
-    mutex_unlock(&rb_lock);
+    /* the output is truncated to len - 1 chars */
+    written = sink_terminate(&sink);
     /* returning the number of written chars, casted to int
      * as defined by POSIX standard, to support negative return
      * on error.
      * We consider here that size_t is smaller enough to
      * be casted into int without being truncated
      */
-    return (int) to_copy;
- err:
-    mutex_unlock(&rb_lock);
- err_init:
-    return ret;
+    return (int) written;
 }
 
 int vsprintf(char *dst, const char *fmt, va_list args)
 {
-    size_t  sizew = 0;
-    int     res = -1;
-
-    /* sanitize */
-    if (!dst) {
-        goto err_init;
-    }
-    if (!mutex_trylock(&rb_lock)) {
-        /* unable to lock the ring buffer, another context is currently
-         * using it. As we may be executed in ISR mode, we prefer to
-         * give up instead of waiting for the buffer to be released */
-        goto err_init;
-    }
-    res = print(fmt, args, &sizew);
-    if (res == -1) {
-        ring_buffer_rewind(sizew);
-        goto err;
-    }
-    /* copy the string we have just written to the ring buffer
-     * into the dst string
-     */
-    /* rewind ring buffer content we have just written */
-    ring_buffer_export(dst, sizew);
-    dst[sizew] = '\0';
-    /* unlocking the ring buffer */
-    mutex_unlock(&rb_lock);
-    /* returning the number of written chars, casted to int
-     * as defined by POSIX standard, to support negative return
-     * on error.
-     * We consider here that size_t is smaller enough to
-     * be casted into int without being truncated
-     */
-    return (int) sizew;
- err:
-    mutex_unlock(&rb_lock);
- err_init:
-    return res;
+    /* no size given: dst is considered as large enough */
+    return vsnprintf(dst, (size_t) 0xffffffff, fmt, args);
 }
 
 
@@ -1041,34 +1045,69 @@ int vsprintf(char *dst, const char *fmt, va_list args)
 /* asyncrhonous printf, for handlers */
 int aprintf(const char *fmt, ...)
 {
-    int     res = -1;
-    va_list args;
-    size_t  len;
+    /* one more char for the vsnprintf() terminating byte */
+    char     msg[ALOG_LINE_MAX + 1];
+    va_list  args;
+    int      len;
+    uint32_t pos;
 
-    if (!mutex_trylock(&rb_lock)) {
-        /* unable to lock the ring buffer, another context is currently
-         * using it. As we may be executed in ISR mode, we prefer to
-         * give up instead of waiting for the buffer to be released */
-        return res;
-    }
     va_start(args, fmt);
-    res = print(fmt, args, &len);
+    len = vsnprintf(msg, sizeof(msg), fmt, args);
     va_end(args);
-    /* unlocking the ring buffer */
+    if (len <= 0) {
+        return len;
+    }
+
+    pos = core_ring_reserve(&alog.wr, &alog.rd, ALOG_REC_SZ(len), ALOG_SIZE);
+    if (pos == ALOG_NO_ROOM) {
+        core_atomic_add(&alog_stats.nb_dropped, 1);
+        return -1;
+    }
+
+    alog_copy_in(pos + 4, msg, len);
+    core_ring_commit((volatile uint32_t *) &alog.buf[ALOG_POS(pos)],
+                     ALOG_COMMITTED | (uint32_t) len);
+    core_atomic_add(&alog_stats.nb_records, 1);
+    return 0;
+}
+
+int aprintf_flush(void)
+{
+    int res;
+
+    /* the printf() output kept in the ring buffer (buffered mode) is
+     * sent first, so that the log keeps the calls order */
+    if (!mutex_trylock(&rb_lock)) {
+        return -1;
+    }
+    ring_buffer_flush(true);
+    res = alog_drain();
     mutex_unlock(&rb_lock);
     return res;
 }
 
-int aprintf_flush(void)
+/*
+ * Sending of the printf() output kept in the ring buffer (buffered
+ * mode), the ring buffer being empty otherwise
+ */
+int printf_flush(void)
 {
     if (!mutex_trylock(&rb_lock)) {
-        /* unable to lock the ring buffer, another context is currently
-         * using it. we prefer to give up instead of waiting for the
-         * buffer to be released */
         return -1;
     }
-    print_and_reset_buffer();
-    /* unlocking the ring buffer */
+    ring_buffer_flush(true);
     mutex_unlock(&rb_lock);
     return 0;
 }
+
+int aprintf_stats(struct aprintf_stats *stats)
+{
+    if (!stats) {
+        return -1;
+    }
+    stats->nb_records  = alog_stats.nb_records;
+    stats->nb_dropped  = alog_stats.nb_dropped;
+    stats->max_used_sz = alog_stats.max_used_sz;
+    stats->ring_sz     = ALOG_SIZE;
+    return 0;
+}
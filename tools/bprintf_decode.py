@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+#
+# Decoder of the libstd deferred binary logs (bprintf()).
+#
+# The records are read either from a console capture, where bprintf_flush()
+# sent them as "BPF:" prefixed hex lines (the other lines are printed as is),
+# or from a raw file of little endian 32 bits words given by bprintf_read().
+# The format strings are read from the task ELF file.
+#
+# usage: bprintf_decode.py task.elf [capture.log | --raw words.bin]
+#        (the capture is read from the standard input if not given)
+#
+
+import struct
+import sys
+
+BPRINTF_MAGIC = 0xbf000000
+BPRINTF_MAGIC_MASK = 0xffffff00
+BPRINTF_PREFIX = "BPF:"
+
+
+class Elf32:
+    """Loadable sections of a 32 bits little endian ELF file"""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError("%s: not a 32 bits little endian ELF file" % path)
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, _, sh_addr, sh_offset, sh_size) = \
+                struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            # SHT_NOBITS sections (.bss) have no content
+            if sh_type != 8 and sh_addr:
+                self.sections.append((sh_addr, sh_offset, sh_size))
+
+    def string(self, addr):
+        for (sh_addr, sh_offset, sh_size) in self.sections:
+            if sh_addr <= addr < sh_addr + sh_size:
+                start = sh_offset + addr - sh_addr
+                end = self.data.index(b"\0", start)
+                return self.data[start:end].decode("latin-1")
+        return None
+
+
+def to_signed(value, bits):
+    value &= (1 << bits) - 1
+    return value - (1 << bits) if value >> (bits - 1) else value
+
+
+def format_record(elf, fmt, args):
+    """Format a record the way the libstd printf() does"""
+    out = []
+    i = 0
+    while i < len(fmt):
+        if fmt[i] != "%":
+            out.append(fmt[i])
+            i += 1
+            continue
+        i += 1
+        pad = 0
+        if i < len(fmt) and fmt[i] == "0":
+            i += 1
+            while i < len(fmt) and fmt[i].isdigit():
+                pad = pad * 10 + int(fmt[i])
+                i += 1
+        if i >= len(fmt):
+            return "".join(out) + " <bad format>"
+        conv = fmt[i]
+        i += 1
+        if conv == "%":
+            out.append("%")
+            continue
+        if conv in "lh" and i < len(fmt) and fmt[i] == conv:
+            conv += conv
+            i += 1
+        if not args:
+            return "".join(out) + " <missing argument>"
+        value = args.pop(0)
+        if conv in ("d", "i", "l", "ll"):
+            text = str(to_signed(value, 32))
+        elif conv == "h":
+            text = str(to_signed(value, 16))
+        elif conv == "hh":
+            text = str(value & 0xff)
+        elif conv == "u":
+            text = str(value)
+        elif conv == "x":
+            text = "%x" % value
+        elif conv == "o":
+            text = "%o" % value
+        elif conv == "p":
+            out.append("0x" + ("%x" % value).rjust(pad, "0"))
+            continue
+        elif conv == "c":
+            out.append(chr(value & 0xff))
+            continue
+        elif conv == "s":
+            string = elf.string(value)
+            out.append(string if string is not None else "<0x%08x>" % value)
+            continue
+        else:
+            return "".join(out) + " <bad format>"
+        if text.startswith("-"):
+            out.append("-" + text[1:].rjust(pad - 1, "0"))
+        else:
+            out.append(text.rjust(pad, "0"))
+    return "".join(out)
+
+
+def decode_words(elf, words):
+    """Decode a list of records words, returning the text lines"""
+    lines = []
+    i = 0
+    while i < len(words):
+        if (words[i] & BPRINTF_MAGIC_MASK) != BPRINTF_MAGIC:
+            # out of sync: look for the next record header
+            i += 1
+            continue
+        nargs = words[i] & ~BPRINTF_MAGIC_MASK & 0xffffffff
+        rec = words[i + 1:i + 2 + nargs]
+        i += 2 + nargs
+        if len(rec) < 1 + nargs:
+            lines.append("<truncated record>")
+            break
+        if rec[0] == 0:
+            lines.append("<%u records lost>" % rec[1])
+            continue
+        fmt = elf.string(rec[0])
+        if fmt is None:
+            lines.append("<unknown format 0x%08x>" % rec[0])
+            continue
+        lines.append(format_record(elf, fmt, list(rec[1:])))
+    return lines
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: bprintf_decode.py task.elf "
+                         "[capture.log | --raw words.bin]\n")
+        return 1
+    elf = Elf32(sys.argv[1])
+
+    if len(sys.argv) > 3 and sys.argv[2] == "--raw":
+        with open(sys.argv[3], "rb") as f:
+            data = f.read()
+        words = list(struct.unpack("<%dI" % (len(data) // 4), data[:len(data) & ~3]))
+        for line in decode_words(elf, words):
+            print(line)
+        return 0
+
+    capture = open(sys.argv[2], "r", errors="replace") if len(sys.argv) > 2 else sys.stdin
+    for line in capture:
+        pos = line.find(BPRINTF_PREFIX)
+        if pos < 0:
+            sys.stdout.write(line)
+            continue
+        hexa = line[pos + len(BPRINTF_PREFIX):].strip()
+        words = [int(hexa[j:j + 8], 16) for j in range(0, len(hexa) - 7, 8)]
+        prefix = line[:pos]
+        for text in decode_words(elf, words):
+            print(prefix + text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,311 @@
+/*
+ * Host replay of the allocation traces recorded by wmalloc_trace_read().
+ *
+ * This file is not part of the library: it is built for the host by
+ * wmalloc_replay.sh, with the allocator sources of one backend, and
+ * replays a raw dump of packed records (13 bytes each, little endian,
+ * as given by wmalloc_trace_read()) against this backend.
+ *
+ * The blocks are matched by their offset from the heap start in the
+ * trace. A wfree() whose block was allocated before the trace start (or
+ * whose allocation failed in the replay) is skipped. The allocations
+ * which failed on the target are not replayed.
+ *
+ * Printed metrics:
+ *   - throughput: replayed calls per second (host time)
+ *   - blocks scanned per wmalloc() call (wmalloc_stats() nb_scanned)
+ *   - fragmentation: 1 - largest free block / free memory, at the end of
+ *     the replay and the worst one sampled during the replay
+ *
+ * usage: wmalloc_replay name trace.bin
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/* Heap region given to the allocator (see the link flags of wmalloc_replay.sh) */
+#ifndef REPLAY_HEAP_ADDR
+# define REPLAY_HEAP_ADDR   0x10000000
+#endif
+#ifndef REPLAY_HEAP_SIZE
+# define REPLAY_HEAP_SIZE   65536
+#endif
+
+/* Values of the record op field (see api/libc/malloc.h) */
+#define TRACE_ALLOC             0x01
+#define TRACE_ALLOC_SENSITIVE   0x02
+#define TRACE_FREE              0x03
+#define TRACE_REALLOC           0x04
+#define TRACE_FAILED            0x80
+
+#define TRACE_REC_SZ            13
+
+/* Fragmentation sampling period (calls), out of the timed sections */
+#define SAMPLE_PERIOD           64
+
+/* Same layout as struct wmalloc_stats (api/libc/malloc.h) */
+struct replay_stats {
+    uint32_t heap_sz;
+    uint32_t used_sz;
+    uint32_t free_sz;
+    uint32_t max_used_sz;
+    uint32_t largest_free_sz;
+    uint32_t nb_free_blocks;
+    uint32_t nb_allocs;
+    uint32_t nb_frees;
+    uint32_t nb_failed;
+    uint32_t nb_aligned;
+    uint32_t align_slack_sz;
+    uint32_t nb_scanned;
+    uint32_t nb_bad_pending;
+};
+
+struct rec {
+    uint32_t tick;
+    uint32_t len;
+    uint32_t off;
+    uint8_t  op;
+};
+
+/* Allocator API (built with 32 bits sizes) */
+extern uint32_t malloc_errno;
+int wmalloc_init(void);
+int wmalloc(void **ptr_to_alloc, const uint32_t len, const int flag);
+int wfree(void **ptr_to_free);
+int wrealloc(void **ptr_to_realloc, const uint32_t len);
+int wmalloc_stats(struct replay_stats *stats);
+
+
+/* Host stand-ins of the libstd locking functions (single threaded replay) */
+
+void semaphore_init(uint8_t value, volatile uint32_t *sem)
+{
+    *sem = value;
+}
+
+bool semaphore_trylock(volatile uint32_t *sem)
+{
+    if (!*sem) {
+        return false;
+    }
+    --*sem;
+    return true;
+}
+
+bool semaphore_release(volatile uint32_t *sem)
+{
+    ++*sem;
+    return true;
+}
+
+void mutex_init(volatile uint32_t *mutex)
+{
+    *mutex = 1;
+}
+
+bool mutex_trylock(volatile uint32_t *mutex)
+{
+    return semaphore_trylock(mutex);
+}
+
+void mutex_unlock(volatile uint32_t *mutex)
+{
+    ++*mutex;
+}
+
+
+/* Trace offsets to replayed blocks (open addressing, offsets are never 0
+ * for a block, the heap starting with block 0) */
+
+static uint32_t *map_off;
+static void    **map_ptr;
+static uint32_t  map_mask;
+
+static uint32_t map_slot(uint32_t off)
+{
+    uint32_t i = (off * 2654435761u) & map_mask;
+
+    while (map_off[i] && (map_off[i] != off)) {
+        i = (i + 1) & map_mask;
+    }
+    return i;
+}
+
+static void map_set(uint32_t off, void *ptr)
+{
+    uint32_t i = map_slot(off);
+
+    map_off[i] = off;
+    map_ptr[i] = ptr;
+}
+
+static void **map_get(uint32_t off)
+{
+    uint32_t i = map_slot(off);
+
+    return (map_off[i] && map_ptr[i]) ? &map_ptr[i] : NULL;
+}
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000u + (uint64_t) t.tv_nsec;
+}
+
+static double fragmentation(const struct replay_stats *st)
+{
+    if (!st->free_sz) {
+        return 0.0;
+    }
+    return 100.0 * (1.0 - (double) st->largest_free_sz / (double) st->free_sz);
+}
+
+static struct rec *load(const char *path, uint32_t *nb)
+{
+    FILE          *f = fopen(path, "rb");
+    struct rec    *recs = NULL;
+    uint8_t        raw[TRACE_REC_SZ];
+    uint32_t       max = 0;
+
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    *nb = 0;
+    while (fread(raw, 1, TRACE_REC_SZ, f) == TRACE_REC_SZ) {
+        if (*nb == max) {
+            max = max ? 2 * max : 1024;
+            recs = realloc(recs, max * sizeof(*recs));
+            if (!recs) {
+                fclose(f);
+                return NULL;
+            }
+        }
+        recs[*nb].tick = raw[0] | (raw[1] << 8) | (raw[2] << 16) | ((uint32_t) raw[3] << 24);
+        recs[*nb].len  = raw[4] | (raw[5] << 8) | (raw[6] << 16) | ((uint32_t) raw[7] << 24);
+        recs[*nb].off  = raw[8] | (raw[9] << 8) | (raw[10] << 16) | ((uint32_t) raw[11] << 24);
+        recs[*nb].op   = raw[12];
+        ++*nb;
+    }
+    fclose(f);
+    return recs;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct replay_stats st;
+    struct rec *recs;
+    uint32_t    nb = 0;
+    uint32_t    i, j, end;
+    uint32_t    nb_calls = 0, nb_failed = 0, nb_target_failed = 0, nb_unknown = 0;
+    uint64_t    t0, elapsed = 0;
+    double      frag_worst = 0.0;
+    void       *ptr;
+    void      **slot;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s name trace.bin\n", argv[0]);
+        return 1;
+    }
+    if (!(recs = load(argv[2], &nb))) {
+        return 1;
+    }
+
+    if (mmap((void *) REPLAY_HEAP_ADDR, REPLAY_HEAP_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != (void *) REPLAY_HEAP_ADDR) {
+        perror("mmap");
+        return 1;
+    }
+    if (wmalloc_init() < 0) {
+        fprintf(stderr, "%s: wmalloc_init() failed (malloc_errno %u)\n", argv[1], malloc_errno);
+        return 1;
+    }
+
+    for (map_mask = 1024; map_mask < 2 * nb; map_mask <<= 1) {
+    }
+    map_off = calloc(map_mask, sizeof(*map_off));
+    map_ptr = calloc(map_mask, sizeof(*map_ptr));
+    --map_mask;
+    if (!map_off || !map_ptr) {
+        return 1;
+    }
+
+    for (i = 0; i < nb; i = end) {
+        end = (nb - i > SAMPLE_PERIOD) ? i + SAMPLE_PERIOD : nb;
+
+        t0 = now_ns();
+        for (j = i; j < end; j++) {
+            const struct rec *r = &recs[j];
+
+            if (r->op & TRACE_FAILED) {
+                ++nb_target_failed;
+                continue;
+            }
+            switch (r->op) {
+            case TRACE_ALLOC:
+            case TRACE_ALLOC_SENSITIVE:
+                ptr = NULL;
+                ++nb_calls;
+                if (wmalloc(&ptr, r->len, (r->op == TRACE_ALLOC) ? 0 : -1) < 0) {
+                    ++nb_failed;
+                    ptr = NULL;
+                }
+                map_set(r->off, ptr);
+                break;
+            case TRACE_FREE:
+                if (!(slot = map_get(r->off))) {
+                    ++nb_unknown;
+                    break;
+                }
+                ++nb_calls;
+                wfree(slot);
+                *slot = NULL;
+                break;
+            case TRACE_REALLOC:
+                if (!(slot = map_get(r->off))) {
+                    ++nb_unknown;
+                    break;
+                }
+                ++nb_calls;
+                if (wrealloc(slot, r->len) < 0) {
+                    ++nb_failed;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        elapsed += now_ns() - t0;
+
+        if (wmalloc_stats(&st) == 0 && fragmentation(&st) > frag_worst) {
+            frag_worst = fragmentation(&st);
+        }
+    }
+
+    if (wmalloc_stats(&st) < 0) {
+        fprintf(stderr, "%s: wmalloc_stats() failed (malloc_errno %u)\n", argv[1], malloc_errno);
+        return 1;
+    }
+
+    printf("%-12s %8u calls %10.0f calls/s %7.2f scanned/wmalloc %6.2f%% frag (worst %6.2f%%)"
+           " %u failed",
+           argv[1], nb_calls, elapsed ? (double) nb_calls * 1e9 / (double) elapsed : 0.0,
+           (st.nb_allocs + st.nb_failed) ?
+               (double) st.nb_scanned / (double) (st.nb_allocs + st.nb_failed) : 0.0,
+           fragmentation(&st), frag_worst, nb_failed);
+    if (nb_target_failed || nb_unknown) {
+        printf(" (%u failed on target, %u unknown blocks)", nb_target_failed, nb_unknown);
+    }
+    printf("\n");
+
+    return 0;
+}
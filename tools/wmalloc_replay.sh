@@ -0,0 +1,117 @@
+#!/bin/sh
+#
+# Host replay of a libstd allocation trace against each allocator backend.
+#
+# The trace is a raw dump of the records given by wmalloc_trace_read()
+# (packed, 13 bytes each). For each backend, the allocator sources are
+# built for the host (x86_64 or any 64 bits Linux host, the heap being
+# mapped below 4 GiB) with the Kconfig defaults, 32 bits sizes and no
+# deferred release, then tools/wmalloc_replay.c replays the trace and
+# prints the throughput, the blocks scanned per wmalloc() call and the
+# heap fragmentation.
+#
+# usage: wmalloc_replay.sh trace.bin [backend...]
+#        backends: light std bins tlsf bitmap (default: all of them), the
+#        light and std ones being replayed with each placement policy (and
+#        the std first fit with each double way search mode)
+#
+# tools/wmalloc_workload.py gives a synthetic trace when no trace of the
+# target is at hand.
+#
+# environment: CC (default gcc), HEAP_SIZE (default 65536 bytes)
+#
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 trace.bin [light|std|bins|tlsf|bitmap...]" >&2
+    exit 1
+fi
+
+TRACE=$1
+shift
+BACKENDS=${*:-light std bins tlsf bitmap}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+CC=${CC:-gcc}
+HEAP_ADDR=0x10000000
+HEAP_SIZE=${HEAP_SIZE:-65536}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# autoconf.h of a backend: $1 = backend option, $2 = placement policy option,
+# $3 = double way search mode
+config()
+{
+    cat <<EOF
+#define CONFIG_ARCH_ARMV7M 1
+#define CONFIG_KERNEL_EWOK 1
+#define CONFIG_RAM_SLOT_SIZE $HEAP_SIZE
+#define CONFIG_STD_MALLOC 1
+#define CONFIG_STD_MALLOC_$1 1
+#define CONFIG_STD_MALLOC_SIZE_LEN 32
+#define CONFIG_STD_MALLOC_ALIGN 1
+#define CONFIG_STD_MALLOC_MUTEX 1
+#define CONFIG_STD_MALLOC_CHECK_IF_NULL 0
+#define CONFIG_STD_MALLOC_DBLE_WAY_SEARCH ${3:-0}
+#define CONFIG_STD_MALLOC_FREEMEM_CHECK 0
+#define CONFIG_STD_MALLOC_BASIC_CHECKS 0
+#define CONFIG_STD_MALLOC_NB_CANARIES 2
+#define CONFIG_STD_MALLOC_INTEGRITY 1
+#define CONFIG_STD_MALLOC_CHECK_STEP 0
+#define CONFIG_STD_MALLOC_RANDOM 0
+#define CONFIG_STD_MALLOC_BITMAP_GRANULE 16
+#define CONFIG_STD_MALLOC_BITMAP_HEAP_MAX $(( (HEAP_SIZE + 1023) / 1024 ))
+EOF
+    if [ -n "$2" ]; then
+        echo "#define CONFIG_STD_MALLOC_$2 1"
+    fi
+}
+
+# build and run: $1 = name, $2 = backend option, $3 = placement policy option,
+# $4 = double way search mode
+replay()
+{
+    dir="$WORK/$1"
+    mkdir -p "$dir"
+    config "$2" "$3" "$4" > "$dir/autoconf.h"
+
+    for src in "$ROOT"/alloc/*.c; do
+        $CC -O2 -c -fno-pie -fcommon -nostdinc -ffreestanding -w \
+            -I"$dir" -I"$ROOT/api" -I"$ROOT/alloc" -I"$ROOT/embed" \
+            -o "$dir/$(basename "$src" .c).o" "$src"
+    done
+    $CC -O2 -c -fno-pie -DREPLAY_HEAP_ADDR=$HEAP_ADDR -DREPLAY_HEAP_SIZE="$HEAP_SIZE" \
+        -o "$dir/wmalloc_replay.o" "$ROOT/tools/wmalloc_replay.c"
+
+    # the task heap starts at the end of the bss, in a single RAM slot
+    $CC -no-pie -o "$dir/replay" "$dir"/*.o \
+        -Wl,--defsym=_s_bss=$HEAP_ADDR,--defsym=_e_bss=$HEAP_ADDR \
+        -Wl,--defsym=_s_data=0,--defsym=_e_data=0 \
+        -Wl,--defsym=_s_stack=0,--defsym=_e_stack=0,--defsym=numslots=1
+
+    "$dir/replay" "$1" "$TRACE"
+}
+
+for backend in $BACKENDS; do
+    case $backend in
+        light|std)
+            option=$(echo "$backend" | tr a-z A-Z)
+            replay "$backend-first" "$option" FIRST_FIT
+            replay "$backend-next" "$option" NEXT_FIT
+            replay "$backend-best" "$option" BEST_FIT
+            if [ "$backend" = std ]; then
+                replay "std-way1" STD FIRST_FIT 1
+                replay "std-way2" STD FIRST_FIT 2
+            fi
+            ;;
+        bins|tlsf|bitmap)
+            replay "$backend" "$(echo "$backend" | tr a-z A-Z)" ""
+            ;;
+        *)
+            echo "unknown backend $backend" >&2
+            exit 1
+            ;;
+    esac
+done
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# Decoder of the libstd allocation traces (wmalloc_trace_read()).
+#
+# The trace is a raw dump of packed records (13 bytes each, little
+# endian): systick (low 32 bits, microseconds), asked length, offset of
+# the data from the heap start, and operation. Each record is printed as
+# a text line, followed by a summary of the calls and of the live
+# memory seen by the trace. tools/wmalloc_replay.sh replays the same
+# dump against each allocator backend.
+#
+# usage: wmalloc_trace_decode.py trace.bin [--summary]
+#
+
+import struct
+import sys
+
+TRACE_REC = struct.Struct("<IIIB")
+
+TRACE_OPS = {
+    0x01: "alloc",
+    0x02: "alloc_sensitive",
+    0x03: "free",
+    0x04: "realloc",
+}
+TRACE_FAILED = 0x80
+
+
+def read_records(path):
+    """Records of a raw dump, as (tick, len, off, op) tuples"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) % TRACE_REC.size:
+        sys.stderr.write("%s: %u trailing bytes ignored\n"
+                         % (path, len(data) % TRACE_REC.size))
+    return [TRACE_REC.unpack_from(data, pos)
+            for pos in range(0, len(data) - TRACE_REC.size + 1, TRACE_REC.size)]
+
+
+def op_name(op):
+    name = TRACE_OPS.get(op & ~TRACE_FAILED, "op_0x%02x" % (op & ~TRACE_FAILED))
+    return name + (" FAILED" if op & TRACE_FAILED else "")
+
+
+def summary(records):
+    """Calls counts, live blocks and live memory peak (asked lengths)"""
+    counts = {}
+    live = {}
+    live_sz = 0
+    peak_sz = 0
+    unknown = 0
+    for (_, length, off, op) in records:
+        counts[op_name(op)] = counts.get(op_name(op), 0) + 1
+        if op & TRACE_FAILED:
+            continue
+        op &= ~TRACE_FAILED
+        if op in (0x01, 0x02):
+            live_sz += length - live.get(off, 0)
+            live[off] = length
+        elif op == 0x03:
+            if off in live:
+                live_sz -= live.pop(off)
+            else:
+                unknown += 1
+        elif op == 0x04 and off in live:
+            live_sz += length - live[off]
+            live[off] = length
+        peak_sz = max(peak_sz, live_sz)
+
+    lines = ["%u records" % len(records)]
+    if records:
+        lines.append("duration: %u us" % ((records[-1][0] - records[0][0]) & 0xffffffff))
+    for name in sorted(counts):
+        lines.append("%-22s %u" % (name, counts[name]))
+    lines.append("live blocks at end:    %u (%u bytes)" % (len(live), live_sz))
+    lines.append("live bytes peak:       %u" % peak_sz)
+    if unknown:
+        lines.append("frees of blocks allocated before the trace start: %u" % unknown)
+    return lines
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: wmalloc_trace_decode.py trace.bin [--summary]\n")
+        return 1
+    records = read_records(sys.argv[1])
+
+    if "--summary" not in sys.argv[2:]:
+        for (tick, length, off, op) in records:
+            print("%10u %-22s len %6u off 0x%08x" % (tick, op_name(op), length, off))
+        print("")
+    for line in summary(records):
+        print(line)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# Synthetic workload generator for the libstd allocator replay.
+#
+# Writes a raw dump in the wmalloc_trace_read() format (packed records,
+# 13 bytes each, little endian), so that tools/wmalloc_replay.sh can
+# compare the backends and placement policies on a reproducible load
+# when no trace of the target is at hand. The workload is a random
+# churn over a fixed number of slots: a slot holding a block is freed,
+# an empty one gets a block of 1 to 48 bytes (7 times out of 8) or of 1
+# to 600 bytes. The pseudo-random generator is a fixed LCG, the dump
+# being the same on any host for a given seed.
+#
+# The blocks are identified by a unique offset (never 0), the replay
+# matching the records by offset only.
+#
+# usage: wmalloc_workload.py out.bin [calls] [seed] [slots]
+#        (default: 200000 calls, seed 1, 256 slots)
+#
+# e.g.   wmalloc_workload.py churn.bin
+#        HEAP_SIZE=16384 wmalloc_replay.sh churn.bin light std
+#
+
+import struct
+import sys
+
+TRACE_REC = struct.Struct("<IIIB")
+
+TRACE_ALLOC = 0x01
+TRACE_FREE = 0x03
+
+# Blocks sizes: small ones, and one out of 8 up to the large size
+SMALL_MAX = 48
+LARGE_MAX = 600
+
+
+class Lcg:
+    """31 bits pseudo-random generator (same sequence on any host)"""
+
+    def __init__(self, seed):
+        self.state = seed & 0xffffffff
+
+    def next(self):
+        self.state = (self.state * 1103515245 + 12345) & 0xffffffff
+        return (self.state >> 16) & 0x7fff
+
+
+def workload(calls, seed, slots):
+    """Records of the churn, as (tick, len, off, op) tuples"""
+    rng = Lcg(seed)
+    live = [0] * slots
+    next_off = 0
+    for tick in range(calls):
+        i = rng.next() % slots
+        if live[i]:
+            yield (tick, 0, live[i], TRACE_FREE)
+            live[i] = 0
+        else:
+            length = 1 + rng.next() % (SMALL_MAX if rng.next() & 7 else LARGE_MAX)
+            next_off += 1
+            live[i] = next_off
+            yield (tick, length, next_off, TRACE_ALLOC)
+
+
+def main():
+    if len(sys.argv) < 2 or len(sys.argv) > 5:
+        sys.stderr.write("usage: wmalloc_workload.py out.bin [calls] [seed] [slots]\n")
+        return 1
+    calls = int(sys.argv[2]) if len(sys.argv) > 2 else 200000
+    seed = int(sys.argv[3]) if len(sys.argv) > 3 else 1
+    slots = int(sys.argv[4]) if len(sys.argv) > 4 else 256
+
+    with open(sys.argv[1], "wb") as f:
+        for rec in workload(calls, seed, slots):
+            f.write(TRACE_REC.pack(*rec))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())